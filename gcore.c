@@ -8,8 +8,48 @@ All rights reserved
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <stdint.h>
 #include <math.h>
 #include "gcore.h"
+#include "m3di.h"
+#include "workers.h"
+
+// vector width of the halfspace inner loop, chosen at build time
+#if !defined(GCORE_SCALAR) && defined(__AVX2__)
+#include <immintrin.h>
+#define SIMD_LANES 4
+#define SIMD_Double __m256d
+#define SIMD_SET(x) _mm256_set1_pd(x)
+#define SIMD_RAMP() _mm256_set_pd(3.0, 2.0, 1.0, 0.0)
+#define SIMD_LOAD(p) _mm256_loadu_pd(p)
+#define SIMD_STORE(p, x) _mm256_storeu_pd(p, x)
+#define SIMD_ADD(x, y) _mm256_add_pd(x, y)
+#define SIMD_SUB(x, y) _mm256_sub_pd(x, y)
+#define SIMD_MUL(x, y) _mm256_mul_pd(x, y)
+#define SIMD_DIV(x, y) _mm256_div_pd(x, y)
+#define SIMD_GE(x, y) _mm256_cmp_pd(x, y, _CMP_GE_OQ)
+#define SIMD_GT(x, y) _mm256_cmp_pd(x, y, _CMP_GT_OQ)
+#define SIMD_AND(x, y) _mm256_and_pd(x, y)
+#define SIMD_SELECT(m, x, y) _mm256_blendv_pd(y, x, m)
+#define SIMD_MASK(m) _mm256_movemask_pd(m)
+#elif !defined(GCORE_SCALAR) && defined(__SSE2__)
+#include <emmintrin.h>
+#define SIMD_LANES 2
+#define SIMD_Double __m128d
+#define SIMD_SET(x) _mm_set1_pd(x)
+#define SIMD_RAMP() _mm_set_pd(1.0, 0.0)
+#define SIMD_LOAD(p) _mm_loadu_pd(p)
+#define SIMD_STORE(p, x) _mm_storeu_pd(p, x)
+#define SIMD_ADD(x, y) _mm_add_pd(x, y)
+#define SIMD_SUB(x, y) _mm_sub_pd(x, y)
+#define SIMD_MUL(x, y) _mm_mul_pd(x, y)
+#define SIMD_DIV(x, y) _mm_div_pd(x, y)
+#define SIMD_GE(x, y) _mm_cmpge_pd(x, y)
+#define SIMD_GT(x, y) _mm_cmpgt_pd(x, y)
+#define SIMD_AND(x, y) _mm_and_pd(x, y)
+#define SIMD_SELECT(m, x, y) _mm_or_pd(_mm_and_pd(m, x), _mm_andnot_pd(m, y))
+#define SIMD_MASK(m) _mm_movemask_pd(m)
+#endif
 
 int StringComparator(POLY_Polymorphic key1, POLY_Polymorphic key2)
 {
@@ -239,313 +279,1323 @@ void GCORE_IndexSubsetConstruct(GCORE_IndexSubset *indices, GCORE_ContainerDescr
 	for(int n = 0; AVL_Next(&iter); n++) indices->indices[n] = AVL_Get(&descriptor->map, AVL_Key(&iter));
 }
 
-int GCORE_ClipTriangles(double *buffin, int attributes, int statics, int count, double *buffout, int capacity)
+// number of triangles the clipper classifies together
+#define CLIP_BATCH 64
+
+// marks the region of each vertex (describes on which side of each clipping plane it lies) from its coordinates laid out as a structure of arrays
+// bits 0x01 to 0x20 are outside the w+x=0, w-x=0, w+y=0, w-y=0, w+z=0 and w-z=0 planes, the x and y planes pushed out to the guard band,
+// bits 0x40 to 0x200 are outside the w+x=0, w-x=0, w+y=0 and w-y=0 planes of the cube itself
+void ClipClassify(double *x, double *y, double *z, double *w, int count, double guardband, int *regions)
 {
-	// pointer to current triangle in input buffer
-	double *ctriangle = buffin;
-	// pointer to location in output buffer for next triangle
-	double *wtriangle = buffout;
-	// number of triangles written out
-	int written = 0;
-	// offset to statics in triangle
-	int statoff = 12+3*attributes;
-	// number of doubles in a triangle
-	int pitch = statoff+statics;
-	// loop across all input triangles
-	for(int n = 0; n < count; n++)
+	int i = 0;
+#ifdef SIMD_LANES
+	SIMD_Double vguard = SIMD_SET(guardband);
+	SIMD_Double vzero = SIMD_SET(0.0);
+	SIMD_Double bits[10];
+	for(int j = 0; j < 10; j++) bits[j] = SIMD_SET(1 << j);
+	for(; i+SIMD_LANES <= count; i += SIMD_LANES)
+	{
+		SIMD_Double vx = SIMD_LOAD(x+i);
+		SIMD_Double vy = SIMD_LOAD(y+i);
+		SIMD_Double vz = SIMD_LOAD(z+i);
+		SIMD_Double vw = SIMD_LOAD(w+i);
+		SIMD_Double gw = SIMD_MUL(vguard, vw);
+		SIMD_Double ngw = SIMD_SUB(vzero, gw);
+		SIMD_Double nw = SIMD_SUB(vzero, vw);
+		// each plane a vertex lies outside of adds its bit
+		SIMD_Double code = SIMD_AND(SIMD_GT(ngw, vx), bits[0]);
+		code = SIMD_ADD(code, SIMD_AND(SIMD_GT(vx, gw), bits[1]));
+		code = SIMD_ADD(code, SIMD_AND(SIMD_GT(ngw, vy), bits[2]));
+		code = SIMD_ADD(code, SIMD_AND(SIMD_GT(vy, gw), bits[3]));
+		code = SIMD_ADD(code, SIMD_AND(SIMD_GT(nw, vz), bits[4]));
+		code = SIMD_ADD(code, SIMD_AND(SIMD_GT(vz, vw), bits[5]));
+		code = SIMD_ADD(code, SIMD_AND(SIMD_GT(nw, vx), bits[6]));
+		code = SIMD_ADD(code, SIMD_AND(SIMD_GT(vx, vw), bits[7]));
+		code = SIMD_ADD(code, SIMD_AND(SIMD_GT(nw, vy), bits[8]));
+		code = SIMD_ADD(code, SIMD_AND(SIMD_GT(vy, vw), bits[9]));
+		double codes[SIMD_LANES];
+		SIMD_STORE(codes, code);
+		for(int k = 0; k < SIMD_LANES; k++) regions[i+k] = (int)codes[k];
+	}
+#endif
+	for(; i < count; i++)
+	{
+		double gw = guardband*w[i];
+		regions[i] =
+			(x[i] < -gw)*0x01 | (x[i] > gw)*0x02 | (y[i] < -gw)*0x04 | (y[i] > gw)*0x08 |
+			(z[i] < -w[i])*0x10 | (z[i] > w[i])*0x20 |
+			(x[i] < -w[i])*0x40 | (x[i] > w[i])*0x80 | (y[i] < -w[i])*0x100 | (y[i] > w[i])*0x200;
+	}
+}
+
+// the most triangles the fan of one clipped triangle can hold, a triangle cut by six planes having up to nine vertices
+#define CLIP_FAN 7
+
+int FormatSize(int format)
+{
+	switch(format)
+	{
+		case GCORE_FLOAT32: return sizeof(float);
+		case GCORE_FLOAT16: return sizeof(unsigned short);
+		case GCORE_UNORM8: return sizeof(unsigned char);
+		case GCORE_UNORM24: case GCORE_UNORM32: return sizeof(unsigned int);
+		default: return sizeof(double);
+	}
+}
+
+// rounds to the nearest half precision value, ties to even
+// the double's own 52 bit mantissa is rounded once to 10 bits, so no intermediate rounding through float can move a value onto a midpoint
+unsigned short HalfFromDouble(double value)
+{
+	uint64_t bits;
+	memcpy(&bits, &value, sizeof(double));
+	unsigned int sign = bits >> 48 & 0x8000;
+	int exponent = (int)(bits >> 52 & 0x7FF)-1023+15;
+	uint64_t mantissa = bits & 0xFFFFFFFFFFFFFull;
+	if((bits >> 52 & 0x7FF) == 0x7FF) return sign | 0x7C00 | (mantissa ? 0x200 : 0); // infinity or nan
+	if(exponent >= 31) return sign | 0x7C00; // overflow to infinity
+	uint64_t half, remainder, midpoint;
+	if(exponent <= 0)
+	{
+		// subnormal or underflow to zero
+		if(exponent < -10) return sign;
+		mantissa |= 1ull << 52;
+		int shift = 43-exponent;
+		half = mantissa >> shift;
+		remainder = mantissa & ((1ull << shift)-1);
+		midpoint = 1ull << (shift-1);
+	}
+	else
+	{
+		half = (uint64_t)exponent << 10 | mantissa >> 42;
+		remainder = mantissa & ((1ull << 42)-1);
+		midpoint = 1ull << 41;
+	}
+	// a carry out of the mantissa correctly bumps the exponent
+	if(remainder > midpoint || (remainder == midpoint && (half & 1))) half++;
+	return sign | (unsigned short)half;
+}
+
+double HalfToDouble(unsigned short half)
+{
+	int exponent = half >> 10 & 0x1F;
+	int mantissa = half & 0x3FF;
+	double value;
+	if(exponent == 0) value = ldexp(mantissa, -24);
+	else if(exponent == 31) value = mantissa ? NAN : INFINITY;
+	else value = ldexp(mantissa | 0x400, exponent-25);
+	return half & 0x8000 ? -value : value;
+}
+
+// maps depth from [-1,1] onto the full range of an unsigned normalized format
+unsigned int DepthToUnorm(double z, int format)
+{
+	double scale = format == GCORE_UNORM24 ? 16777215.0 : 4294967295.0;
+	if(!(z > -1)) return 0;
+	if(z >= 1) return (unsigned int)scale;
+	return (unsigned int)llround((z+1)*0.5*scale);
+}
+
+void GCORE_FramebufferInitialize(GCORE_Framebuffer *framebuffer, int width, int height, int depthformat, int channels, int *formats, int layout)
+{
+	size_t pixels = (size_t)width*height;
+	framebuffer->width = width;
+	framebuffer->height = height;
+	framebuffer->depthformat = depthformat;
+	framebuffer->zbuff = malloc(pixels*FormatSize(depthformat));
+	framebuffer->channels = channels;
+	framebuffer->layout = layout;
+	framebuffer->formats = NULL;
+	framebuffer->offsets = NULL;
+	framebuffer->strides = NULL;
+	framebuffer->size = pixels*channels*sizeof(double);
+	for(int i = 0; formats && i < channels; i++)
+	{
+		if(formats[i] != GCORE_FLOAT64)
+		{
+			framebuffer->formats = malloc(channels*sizeof(int));
+			framebuffer->offsets = malloc(channels*sizeof(size_t));
+			framebuffer->strides = malloc(channels*sizeof(int));
+			memcpy(framebuffer->formats, formats, channels*sizeof(int));
+			if(layout == GCORE_PLANAR)
+			{
+				// each channel gets a plane of its own, every plane starting on a double boundary
+				size_t offset = 0;
+				for(int j = 0; j < channels; j++)
+				{
+					framebuffer->offsets[j] = offset;
+					framebuffer->strides[j] = FormatSize(formats[j]);
+					offset += (pixels*framebuffer->strides[j]+sizeof(double)-1)/sizeof(double)*sizeof(double);
+				}
+				framebuffer->size = offset;
+			}
+			else
+			{
+				// channels are packed in the order given, each aligned to its own size
+				int offset = 0, alignment = 1;
+				for(int j = 0; j < channels; j++)
+				{
+					int size = FormatSize(formats[j]);
+					offset = (offset+size-1)/size*size;
+					framebuffer->offsets[j] = offset;
+					offset += size;
+					if(size > alignment) alignment = size;
+				}
+				int pixelsize = (offset+alignment-1)/alignment*alignment;
+				for(int j = 0; j < channels; j++) framebuffer->strides[j] = pixelsize;
+				framebuffer->size = pixels*pixelsize;
+			}
+			break;
+		}
+	}
+	// with every channel in double precision and interleaved the attribute buffer has the layout GCORE_TriangleRaster writes
+	framebuffer->abuff = malloc(framebuffer->size);
+	framebuffer->vbuff = NULL;
+	framebuffer->hierarchy = NULL;
+}
+
+void FramebufferWrap(GCORE_Framebuffer *framebuffer, double *zbuff, double *abuff, GCORE_Visibility *vbuff, int channels, int width, int height, GCORE_DepthHierarchy *hierarchy)
+{
+	framebuffer->width = width;
+	framebuffer->height = height;
+	framebuffer->depthformat = GCORE_FLOAT64;
+	framebuffer->zbuff = zbuff;
+	framebuffer->channels = channels;
+	framebuffer->layout = GCORE_INTERLEAVED;
+	framebuffer->formats = NULL;
+	framebuffer->offsets = NULL;
+	framebuffer->strides = NULL;
+	framebuffer->size = (size_t)width*height*channels*sizeof(double);
+	framebuffer->abuff = abuff;
+	framebuffer->vbuff = vbuff;
+	framebuffer->hierarchy = hierarchy;
+}
+
+// performs the depth test at a pixel and stores the depth if it passes, or unconditionally if accepted
+// returns 1 if the test passed, 0 otherwise
+int FramebufferDepthTest(GCORE_Framebuffer *framebuffer, int index, double z, int accept)
+{
+	switch(framebuffer->depthformat)
+	{
+		case GCORE_FLOAT32:
+		{
+			float *zbuff = framebuffer->zbuff;
+			float value = z;
+			if(!accept && value < zbuff[index]) return 0;
+			zbuff[index] = value;
+			return 1;
+		}
+		case GCORE_UNORM24: case GCORE_UNORM32:
+		{
+			unsigned int *zbuff = framebuffer->zbuff;
+			unsigned int value = DepthToUnorm(z, framebuffer->depthformat);
+			if(!accept && value < zbuff[index]) return 0;
+			zbuff[index] = value;
+			return 1;
+		}
+		default:
+		{
+			double *zbuff = framebuffer->zbuff;
+			if(!accept && z < zbuff[index]) return 0;
+			zbuff[index] = z;
+			return 1;
+		}
+	}
+}
+
+// finds the range of depths which would be stored as the value at a pixel
+void FramebufferDepthRange(GCORE_Framebuffer *framebuffer, int index, double *low, double *high)
+{
+	switch(framebuffer->depthformat)
+	{
+		case GCORE_FLOAT32:
+		{
+			float value = ((float*)framebuffer->zbuff)[index];
+			*low = nextafterf(value, -INFINITY);
+			*high = value;
+			break;
+		}
+		case GCORE_UNORM24: case GCORE_UNORM32:
+		{
+			double scale = framebuffer->depthformat == GCORE_UNORM24 ? 16777215.0 : 4294967295.0;
+			unsigned int value = ((unsigned int*)framebuffer->zbuff)[index];
+			*low = value ? (value-0.5)*2.0/scale-1 : -INFINITY;
+			*high = value*2.0/scale-1;
+			break;
+		}
+		default:
+			*low = *high = ((double*)framebuffer->zbuff)[index];
+	}
+}
+
+// finds the distances in doubles between pixels and between channels of an attribute buffer with every channel in double precision
+void FramebufferStrides(GCORE_Framebuffer *framebuffer, size_t *pixelstride, size_t *channelstride)
+{
+	if(framebuffer->layout == GCORE_PLANAR)
+	{
+		*pixelstride = 1;
+		*channelstride = (size_t)framebuffer->width*framebuffer->height;
+	}
+	else
+	{
+		*pixelstride = framebuffer->channels;
+		*channelstride = 1;
+	}
+}
+
+void FramebufferWrite(GCORE_Framebuffer *framebuffer, int index, int channel, double value)
+{
+	if(!framebuffer->formats)
+	{
+		size_t pixelstride, channelstride;
+		FramebufferStrides(framebuffer, &pixelstride, &channelstride);
+		((double*)framebuffer->abuff)[pixelstride*index+channelstride*channel] = value;
+		return;
+	}
+	char *location = (char*)framebuffer->abuff+framebuffer->offsets[channel]+(size_t)framebuffer->strides[channel]*index;
+	switch(framebuffer->formats[channel])
+	{
+		case GCORE_FLOAT32:
+			*(float*)location = value;
+			break;
+		case GCORE_FLOAT16:
+			*(unsigned short*)location = HalfFromDouble(value);
+			break;
+		case GCORE_UNORM8:
+			*(unsigned char*)location = value > 0 ? value < 1 ? (unsigned char)lround(value*255) : 255 : 0;
+			break;
+		default:
+			*(double*)location = value;
+	}
+}
+
+double GCORE_FramebufferRead(GCORE_Framebuffer *framebuffer, int x, int y, int channel)
+{
+	int index = x+framebuffer->width*y;
+	if(!framebuffer->formats)
 	{
-		// region for each vertex (describes on which side of each clipping plane it lies)
-		unsigned char regions[3];
-		// mark the regions of each vertex
+		size_t pixelstride, channelstride;
+		FramebufferStrides(framebuffer, &pixelstride, &channelstride);
+		return ((double*)framebuffer->abuff)[pixelstride*index+channelstride*channel];
+	}
+	char *location = (char*)framebuffer->abuff+framebuffer->offsets[channel]+(size_t)framebuffer->strides[channel]*index;
+	switch(framebuffer->formats[channel])
+	{
+		case GCORE_FLOAT32: return *(float*)location;
+		case GCORE_FLOAT16: return HalfToDouble(*(unsigned short*)location);
+		case GCORE_UNORM8: return *(unsigned char*)location/255.0;
+		default: return *(double*)location;
+	}
+}
+
+void *GCORE_FramebufferChannel(GCORE_Framebuffer *framebuffer, int channel, int *stride)
+{
+	if(!framebuffer->formats)
+	{
+		size_t pixelstride, channelstride;
+		FramebufferStrides(framebuffer, &pixelstride, &channelstride);
+		*stride = pixelstride*sizeof(double);
+		return (double*)framebuffer->abuff+channelstride*channel;
+	}
+	*stride = framebuffer->strides[channel];
+	return (char*)framebuffer->abuff+framebuffer->offsets[channel];
+}
+
+double GCORE_FramebufferDepth(GCORE_Framebuffer *framebuffer, int x, int y)
+{
+	int index = x+framebuffer->width*y;
+	switch(framebuffer->depthformat)
+	{
+		case GCORE_FLOAT32: return ((float*)framebuffer->zbuff)[index];
+		case GCORE_UNORM24: return ((unsigned int*)framebuffer->zbuff)[index]*2.0/16777215.0-1;
+		case GCORE_UNORM32: return ((unsigned int*)framebuffer->zbuff)[index]*2.0/4294967295.0-1;
+		default: return ((double*)framebuffer->zbuff)[index];
+	}
+}
+
+// margin keeping hierarchy tests conservative against rounding in the per pixel depth
+#define DEPTH_SLACK 1e-12
+
+void GCORE_DepthHierarchyInitialize(GCORE_DepthHierarchy *hierarchy, int width, int height)
+{
+	hierarchy->columns = (width+GCORE_DEPTHBLOCK-1)/GCORE_DEPTHBLOCK;
+	hierarchy->rows = (height+GCORE_DEPTHBLOCK-1)/GCORE_DEPTHBLOCK;
+	hierarchy->zmin = malloc(hierarchy->columns*hierarchy->rows*sizeof(double));
+	hierarchy->zmax = malloc(hierarchy->columns*hierarchy->rows*sizeof(double));
+	for(int i = 0; i < hierarchy->columns*hierarchy->rows; i++)
+	{
+		hierarchy->zmin[i] = -INFINITY;
+		hierarchy->zmax[i] = INFINITY;
+	}
+}
+
+void DepthHierarchyUpdate(GCORE_DepthHierarchy *hierarchy, GCORE_Framebuffer *framebuffer, int index)
+{
+	int width = framebuffer->width;
+	int height = framebuffer->height;
+	int x0 = index%hierarchy->columns*GCORE_DEPTHBLOCK;
+	int y0 = index/hierarchy->columns*GCORE_DEPTHBLOCK;
+	int x1 = x0+GCORE_DEPTHBLOCK < width ? x0+GCORE_DEPTHBLOCK : width;
+	int y1 = y0+GCORE_DEPTHBLOCK < height ? y0+GCORE_DEPTHBLOCK : height;
+	double zmin = INFINITY, zmax = -INFINITY;
+	for(int y = y0; y < y1; y++)
+	{
+		for(int x = x0; x < x1; x++)
+		{
+			double low, high;
+			FramebufferDepthRange(framebuffer, x+width*y, &low, &high);
+			if(low < zmin) zmin = low;
+			if(high > zmax) zmax = high;
+		}
+	}
+	hierarchy->zmin[index] = zmin;
+	hierarchy->zmax[index] = zmax;
+}
+
+void GCORE_DepthHierarchyBuild(GCORE_DepthHierarchy *hierarchy, double *zbuff, int width, int height)
+{
+	GCORE_Framebuffer framebuffer;
+	FramebufferWrap(&framebuffer, zbuff, NULL, NULL, 0, width, height, hierarchy);
+	for(int i = 0; i < hierarchy->columns*hierarchy->rows; i++) DepthHierarchyUpdate(hierarchy, &framebuffer, i);
+}
+
+void GCORE_DepthHierarchyClean(GCORE_DepthHierarchy *hierarchy)
+{
+	free(hierarchy->zmin);
+	free(hierarchy->zmax);
+	hierarchy->zmin = NULL;
+	hierarchy->zmax = NULL;
+}
+
+int DepthHierarchyOccluded(GCORE_DepthHierarchy *hierarchy, int left, int top, int right, int bottom, double zmax)
+{
+	// every pixel in the rectangle already holds a depth greater than zmax
+	for(int by = top/GCORE_DEPTHBLOCK; by*GCORE_DEPTHBLOCK < bottom; by++)
+	{
+		for(int bx = left/GCORE_DEPTHBLOCK; bx*GCORE_DEPTHBLOCK < right; bx++)
+		{
+			if(!(zmax+DEPTH_SLACK*(1+fabs(zmax)) < hierarchy->zmin[bx+hierarchy->columns*by])) return 0;
+		}
+	}
+	return 1;
+}
+
+void GCORE_FramebufferClear(GCORE_Framebuffer *framebuffer)
+{
+	int pixels = framebuffer->width*framebuffer->height;
+	for(int i = 0; i < pixels; i++)
+	{
+		switch(framebuffer->depthformat)
+		{
+			case GCORE_FLOAT32: ((float*)framebuffer->zbuff)[i] = -INFINITY; break;
+			case GCORE_UNORM24: case GCORE_UNORM32: ((unsigned int*)framebuffer->zbuff)[i] = 0; break;
+			default: ((double*)framebuffer->zbuff)[i] = -INFINITY;
+		}
+	}
+	memset(framebuffer->abuff, 0, framebuffer->size);
+	if(framebuffer->vbuff) GCORE_VisibilityClear(framebuffer->vbuff, framebuffer->width, framebuffer->height);
+	if(framebuffer->hierarchy)
+	{
+		for(int i = 0; i < framebuffer->hierarchy->columns*framebuffer->hierarchy->rows; i++) DepthHierarchyUpdate(framebuffer->hierarchy, framebuffer, i);
+	}
+}
+
+void GCORE_FramebufferClean(GCORE_Framebuffer *framebuffer)
+{
+	free(framebuffer->zbuff);
+	free(framebuffer->abuff);
+	free(framebuffer->formats);
+	free(framebuffer->offsets);
+	free(framebuffer->strides);
+	framebuffer->zbuff = NULL;
+	framebuffer->abuff = NULL;
+	framebuffer->formats = NULL;
+	framebuffer->offsets = NULL;
+	framebuffer->strides = NULL;
+}
+
+// finds the range of pixels whose centers lie between two snapped coordinates, clipped to the raster
+void PixelCenters(long long fmin, long long fmax, int size, long long *first, long long *last)
+{
+	long long half = 1 << (GCORE_SUBPIXEL-1);
+	long long one = 1 << GCORE_SUBPIXEL;
+	// pixel n has its center at n*one+half
+	*first = fmin-half > 0 ? (fmin-half+one-1)/one : 0;
+	*last = fmax-half >= 0 ? (fmax-half)/one : -1;
+	if(*last > size-1) *last = size-1;
+}
+
+// fills a plane equation from values at the vertices, the plane gives the value at pixel (x,y) as plane[0]*(x-left)+plane[1]*(y-top)+plane[2]
+void PlaneEquation(GCORE_TriangleSetup *setup, double *values, double invarea, double *plane)
+{
+	plane[0] = (setup->stepx[0]*values[0]+setup->stepx[1]*values[1]+setup->stepx[2]*values[2])*invarea;
+	plane[1] = (setup->stepy[0]*values[0]+setup->stepy[1]*values[1]+setup->stepy[2]*values[2])*invarea;
+	plane[2] = (setup->edge[0]*values[0]+setup->edge[1]*values[1]+setup->edge[2]*values[2])*invarea;
+}
+
+// divisions by a positive divisor rounding toward negative and positive infinity
+long long FloorDivide(long long a, long long b)
+{
+	return a >= 0 ? a/b : -((-a+b-1)/b);
+}
+
+long long CeilDivide(long long a, long long b)
+{
+	return a >= 0 ? (a+b-1)/b : -(-a/b);
+}
+
+void ScanlineTriangle(GCORE_TriangleSetup *setup, int index, int attributes, int statics, GCORE_Framebuffer *framebuffer, int left, int top, int right, int bottom)
+{
+	double *zbuff = framebuffer->zbuff;
+	double *abuff = framebuffer->abuff;
+	GCORE_Visibility *vbuff = framebuffer->vbuff;
+	int width = framebuffer->width;
+	GCORE_DepthHierarchy *hiz = framebuffer->hierarchy;
+	// double depth and attributes are written directly, anything else is converted on the way
+	int plain = framebuffer->depthformat == GCORE_FLOAT64 && !framebuffer->formats;
+	// bounding box intersected with the scissor rectangle
+	int xstart = setup->left > left ? setup->left : left;
+	int xend = setup->right < right ? setup->right : right;
+	int ystart = setup->top > top ? setup->top : top;
+	int yend = setup->bottom < bottom ? setup->bottom : bottom;
+	if(xstart >= xend || ystart >= yend) return;
+	double *stats = setup->statics;
+	size_t pixelstride, channelstride;
+	FramebufferStrides(framebuffer, &pixelstride, &channelstride);
+	// extent of the pixels written, for bringing the depth hierarchy up to date
+	int wxmin = xend, wxmax = xstart, wymin = yend, wymax = ystart;
+	for(int y = ystart; y < yend; y++)
+	{
+		// the span of the row is where all three edge functions pass their fill rule biases, solved exactly from the edges at the left of the bounding box
+		long long xfirst = xstart, xlast = xend;
 		for(int i = 0; i < 3; i++)
 		{
-			double *cvertex = ctriangle + 4*i;
-			regions[i] = 0;
-			if(cvertex[0] < -cvertex[3]) regions[i] |= 0x01; // mark regions outside w+x=0 plane
-			else if(cvertex[0] > cvertex[3]) regions[i] |= 0x02; // mark regions outside w-x=0 plane
-			if(cvertex[1] < -cvertex[3]) regions[i] |= 0x04; // mark regions outside w+y=0 plane
-			else if(cvertex[1] > cvertex[3]) regions[i] |= 0x08; // mark regions outside w-y=0 plane
-			if(cvertex[2] < -cvertex[3]) regions[i] |= 0x10; // mark regions outside w+z=0 plane
-			else if(cvertex[2] > cvertex[3]) regions[i] |= 0x20; // mark regions outside w-z=0 plane
+			long long e = setup->edge[i]+setup->stepy[i]*(y-setup->top);
+			long long stepx = setup->stepx[i];
+			if(stepx > 0)
+			{
+				long long first = setup->left+CeilDivide(setup->bias[i]-e, stepx);
+				if(first > xfirst) xfirst = first;
+			}
+			else if(stepx < 0)
+			{
+				long long last = setup->left+FloorDivide(e-setup->bias[i], -stepx)+1;
+				if(last < xlast) xlast = last;
+			}
+			else if(e < setup->bias[i]) xlast = xfirst;
 		}
-		// trivial accept, entire triangle is within the bounding cube
-		if((regions[0] | regions[1] | regions[2]) == 0)
+		if(xfirst >= xlast) continue;
+		// the planes at the start of the row, only the step along it remains for each pixel
+		double dy = y-setup->top;
+		double rowwinv = setup->winv[1]*dy+setup->winv[2];
+		double rowz = setup->zw[1]*dy+setup->zw[2];
+		if(hiz)
 		{
-			memcpy(wtriangle, ctriangle, pitch*sizeof(double));
-			written++;
-			wtriangle+=pitch;
+			// depth is linear along the span so its ends bound it
+			double zfirst = setup->zw[0]*(xfirst-setup->left)+rowz;
+			double zlast = setup->zw[0]*(xlast-1-setup->left)+rowz;
+			if(DepthHierarchyOccluded(hiz, xfirst, y, xlast, y+1, zfirst > zlast ? zfirst : zlast)) continue;
 		}
-		// trivial reject, entire triangle is on the wrong side of at least one of the clipping planes
-		else if((~((regions[0]^regions[1]) | (regions[1]^regions[2]) | (regions[2]^regions[0]))) & regions[0]);
-		// non-trivial, perform intersections with clipping planes
-		else
+		for(int x = xfirst; x < xlast; x++)
 		{
-			// temporary buffer for barycentric coordinates
-			double barycentric[6][3];
-			// temporary buffer for conventional coordinates
-			double coordinates[6][4];
-			// index into the buffers
-			int index = 0;
-			// loop through the edges of the triangle
-			for(int i = 0; i < 3; i++)
+			double dx = x-setup->left;
+			double z = setup->zw[0]*dx+rowz;
+			if(plain)
 			{
-				// pointer to current vertex
-				double *cvertex = ctriangle + 4*i;
-				// pointer to next vertex 
-				double *nvertex = ctriangle + 4*((i+1)%3);
-				unsigned char cregion = regions[i];
-				unsigned char nregion = regions[(i+1)%3];
-				// accepting the start vertex is still trivial
-				if(!cregion)
+				if(z < zbuff[x+width*y]) continue;
+				zbuff[x+width*y] = z;
+			}
+			else if(!FramebufferDepthTest(framebuffer, x+width*y, z, 0)) continue;
+			if(x < wxmin) wxmin = x;
+			if(x >= wxmax) wxmax = x+1;
+			if(y < wymin) wymin = y;
+			if(y >= wymax) wymax = y+1;
+			// the one reciprocal per pixel, recovering w from the interpolated 1/w
+			double w = 1.0/(setup->winv[0]*dx+rowwinv);
+			if(vbuff)
+			{
+				GCORE_Visibility *record = vbuff+x+width*y;
+				record->triangle = index;
+				record->b1 = (setup->weights[0][0]*dx+(setup->weights[0][1]*dy+setup->weights[0][2]))*w;
+				record->b2 = (setup->weights[1][0]*dx+(setup->weights[1][1]*dy+setup->weights[1][2]))*w;
+				continue;
+			}
+			if(!plain)
+			{
+				for(int i = 0; i < attributes; i++)
 				{
-					memcpy(coordinates[index], cvertex, 4*sizeof(double));
-					for(int k = 0; k < 3; k++) barycentric[index][k] = k==i ? 1.0 : 0.0;
-					index++;
+					double *plane = setup->attributes+3*i;
+					FramebufferWrite(framebuffer, x+width*y, i, (plane[0]*dx+(plane[1]*dy+plane[2]))*w);
 				}
-				// and rejecting an entire edge is also trivial
-				else if((~(cregion^nregion)) & cregion) continue; // some feel continue is just fancy goto
-				// t values (interpolation from current to next vertex)
-				double tvalues[2];
-				// index into t values
-				int tindex = 0;
-				// find planes cut by edge
-				unsigned char planes = cregion^nregion;
-				// loop across all clipping planes
-				for(int j = 0; j < 6; j++)
+				for(int i = 0; i < statics; i++) FramebufferWrite(framebuffer, x+width*y, attributes+i, stats[i]);
+				continue;
+			}
+			double *pixel = abuff+pixelstride*(x+width*y);
+			for(int i = 0; i < attributes; i++)
+			{
+				double *plane = setup->attributes+3*i;
+				pixel[channelstride*i] = (plane[0]*dx+(plane[1]*dy+plane[2]))*w;
+			}
+			for(int i = 0; i < statics; i++) pixel[channelstride*(attributes+i)] = stats[i];
+		}
+	}
+	if(hiz && wxmin < wxmax)
+	{
+		for(int by = wymin/GCORE_DEPTHBLOCK; by*GCORE_DEPTHBLOCK < wymax; by++)
+		{
+			for(int bx = wxmin/GCORE_DEPTHBLOCK; bx*GCORE_DEPTHBLOCK < wxmax; bx++) DepthHierarchyUpdate(hiz, framebuffer, bx+hiz->columns*by);
+		}
+	}
+}
+
+void HalfspaceTriangle(GCORE_TriangleSetup *setup, int index, int attributes, int statics, GCORE_Framebuffer *framebuffer, int left, int top, int right, int bottom)
+{
+	double *zbuff = framebuffer->zbuff;
+	double *abuff = framebuffer->abuff;
+	GCORE_Visibility *vbuff = framebuffer->vbuff;
+	int width = framebuffer->width;
+	GCORE_DepthHierarchy *hiz = framebuffer->hierarchy;
+	// double depth and attributes are written directly, anything else is converted on the way
+	int plain = framebuffer->depthformat == GCORE_FLOAT64 && !framebuffer->formats;
+	// bounding box intersected with the scissor rectangle
+	int xstart = setup->left > left ? setup->left : left;
+	int xend = setup->right < right ? setup->right : right;
+	int ystart = setup->top > top ? setup->top : top;
+	int yend = setup->bottom < bottom ? setup->bottom : bottom;
+	if(xstart >= xend || ystart >= yend) return;
+	if(hiz && DepthHierarchyOccluded(hiz, xstart, ystart, xend, yend, setup->zmax)) return;
+	long long *stepx = setup->stepx;
+	long long *stepy = setup->stepy;
+	int *bias = setup->bias;
+	double *stats = setup->statics;
+	size_t pixelstride, channelstride;
+	FramebufferStrides(framebuffer, &pixelstride, &channelstride);
+	// attribute planes at the start of the current row
+	double rowattrs[attributes+1];
+#ifdef SIMD_LANES
+	// edge values are integers below 2^53, so they step exactly in double lanes
+	SIMD_Double ramp = SIMD_RAMP();
+	SIMD_Double vstep0 = SIMD_MUL(ramp, SIMD_SET(stepx[0]));
+	SIMD_Double vstep1 = SIMD_MUL(ramp, SIMD_SET(stepx[1]));
+	SIMD_Double vstep2 = SIMD_MUL(ramp, SIMD_SET(stepx[2]));
+	SIMD_Double vbias0 = SIMD_SET(bias[0]);
+	SIMD_Double vbias1 = SIMD_SET(bias[1]);
+	SIMD_Double vbias2 = SIMD_SET(bias[2]);
+	SIMD_Double vone = SIMD_SET(1.0);
+#endif
+	// walk the bounding box in blocks aligned to the depth hierarchy
+	for(int by = ystart-ystart%GCORE_DEPTHBLOCK; by < yend; by += GCORE_DEPTHBLOCK)
+	{
+		int y0 = by > ystart ? by : ystart;
+		int y1 = by+GCORE_DEPTHBLOCK < yend ? by+GCORE_DEPTHBLOCK : yend;
+		for(int bx = xstart-xstart%GCORE_DEPTHBLOCK; bx < xend; bx += GCORE_DEPTHBLOCK)
+		{
+			int x0 = bx > xstart ? bx : xstart;
+			int x1 = bx+GCORE_DEPTHBLOCK < xend ? bx+GCORE_DEPTHBLOCK : xend;
+			// edge values at the first pixel of the block
+			long long block[3];
+			int outside = 0;
+			for(int i = 0; i < 3; i++)
+			{
+				block[i] = setup->edge[i]+stepx[i]*(x0-setup->left)+stepy[i]*(y0-setup->top);
+				// edge functions are linear, so the largest value over the block is at one of its corners
+				long long emax = block[i]+(stepx[i] > 0 ? stepx[i]*(x1-1-x0) : 0)+(stepy[i] > 0 ? stepy[i]*(y1-1-y0) : 0);
+				if(emax < bias[i]) outside = 1;
+			}
+			if(outside) continue;
+			// nothing is written to a block the triangle cannot reach in front of, and no depth is read where it is in front of everything
+			int accept = 0;
+			int hizindex = 0;
+			if(hiz)
+			{
+				double dzdx = setup->zw[0];
+				double dzdy = setup->zw[1];
+				double zcorner = dzdx*(x0-setup->left)+dzdy*(y0-setup->top)+setup->zw[2];
+				double zhigh = zcorner+(dzdx > 0 ? dzdx*(x1-1-x0) : 0)+(dzdy > 0 ? dzdy*(y1-1-y0) : 0);
+				double zlow = zcorner+(dzdx < 0 ? dzdx*(x1-1-x0) : 0)+(dzdy < 0 ? dzdy*(y1-1-y0) : 0);
+				if(zhigh > setup->zmax) zhigh = setup->zmax;
+				if(zlow < setup->zmin) zlow = setup->zmin;
+				hizindex = bx/GCORE_DEPTHBLOCK+hiz->columns*(by/GCORE_DEPTHBLOCK);
+				if(zhigh+DEPTH_SLACK*(1+fabs(zhigh)) < hiz->zmin[hizindex]) continue;
+				accept = zlow-DEPTH_SLACK*(1+fabs(zlow)) >= hiz->zmax[hizindex];
+			}
+			int written = 0;
+			for(int y = y0; y < y1; y++)
+			{
+				long long e0 = block[0], e1 = block[1], e2 = block[2];
+				// the planes at the start of the row, only the step along it remains for each pixel
+				double dy = y-setup->top;
+				double rowwinv = setup->winv[1]*dy+setup->winv[2];
+				double rowz = setup->zw[1]*dy+setup->zw[2];
+				double rowb1 = setup->weights[0][1]*dy+setup->weights[0][2];
+				double rowb2 = setup->weights[1][1]*dy+setup->weights[1][2];
+				for(int i = 0; !vbuff && i < attributes; i++) rowattrs[i] = setup->attributes[3*i+1]*dy+setup->attributes[3*i+2];
+				int x = x0;
+#ifdef SIMD_LANES
+				// whole groups of pixels are tested, depth tested and written under a mask, the remainder of the row falls through to the scalar loop
+				for(; plain && x+SIMD_LANES <= x1; x += SIMD_LANES)
 				{
-					// only consider those planes cut by the edge
-					if((planes >> j) & 1)
+					SIMD_Double ve0 = SIMD_ADD(SIMD_SET(e0), vstep0);
+					SIMD_Double ve1 = SIMD_ADD(SIMD_SET(e1), vstep1);
+					SIMD_Double ve2 = SIMD_ADD(SIMD_SET(e2), vstep2);
+					e0 += SIMD_LANES*stepx[0];
+					e1 += SIMD_LANES*stepx[1];
+					e2 += SIMD_LANES*stepx[2];
+					SIMD_Double covered = SIMD_AND(SIMD_AND(SIMD_GE(ve0, vbias0), SIMD_GE(ve1, vbias1)), SIMD_GE(ve2, vbias2));
+					if(!SIMD_MASK(covered)) continue;
+					SIMD_Double dx = SIMD_ADD(SIMD_SET(x-setup->left), ramp);
+					SIMD_Double z = SIMD_ADD(SIMD_MUL(SIMD_SET(setup->zw[0]), dx), SIMD_SET(rowz));
+					double *zpixel = zbuff+x+width*y;
+					SIMD_Double zold = SIMD_LOAD(zpixel);
+					SIMD_Double pass = accept ? covered : SIMD_AND(covered, SIMD_GE(z, zold));
+					int mask = SIMD_MASK(pass);
+					if(!mask) continue;
+					written = 1;
+					// lanes belong to this triangle's scissor rectangle, so writing back the old depths of failed lanes is safe
+					SIMD_STORE(zpixel, SIMD_SELECT(pass, z, zold));
+					SIMD_Double w = SIMD_DIV(vone, SIMD_ADD(SIMD_MUL(SIMD_SET(setup->winv[0]), dx), SIMD_SET(rowwinv)));
+					if(vbuff)
 					{
-						// two dimensional barycentric coordinate across edge
-						double b1, b2;
-						// x, y, or z cutting plane
-						int comp = j/2;
-						if(j%2) // w-comp=0 planes
+						double weights[2][SIMD_LANES];
+						SIMD_STORE(weights[0], SIMD_MUL(SIMD_ADD(SIMD_MUL(SIMD_SET(setup->weights[0][0]), dx), SIMD_SET(rowb1)), w));
+						SIMD_STORE(weights[1], SIMD_MUL(SIMD_ADD(SIMD_MUL(SIMD_SET(setup->weights[1][0]), dx), SIMD_SET(rowb2)), w));
+						for(int k = 0; k < SIMD_LANES; k++)
 						{
-							b1=(cvertex[3]-cvertex[comp])/(nvertex[comp]-cvertex[comp]-nvertex[3]+cvertex[3]);//(cvertex[comp]-cvertex[3])/(cvertex[comp]-nvertex[comp]+nvertex[3]-cvertex[3]);
+							if(!(mask >> k & 1)) continue;
+							GCORE_Visibility *record = vbuff+x+k+width*y;
+							record->triangle = index;
+							record->b1 = weights[0][k];
+							record->b2 = weights[1][k];
 						}
-						else // w+comp=0 planes
+						continue;
+					}
+					double *pixel = abuff+pixelstride*(x+width*y);
+					for(int i = 0; i < attributes+statics; i++)
+					{
+						SIMD_Double value = i < attributes ? SIMD_MUL(SIMD_ADD(SIMD_MUL(SIMD_SET(setup->attributes[3*i]), dx), SIMD_SET(rowattrs[i])), w) : SIMD_SET(stats[i-attributes]);
+						if(pixelstride == 1)
 						{
-							b1=(-cvertex[3]-cvertex[comp])/(nvertex[comp]-cvertex[comp]+nvertex[3]-cvertex[3]);//(cvertex[comp]-cvertex[3])/(cvertex[comp]-nvertex[comp]+nvertex[3]-cvertex[3]);
+							// planar channels are contiguous across the lanes and blended like the depth
+							SIMD_STORE(pixel+channelstride*i, SIMD_SELECT(pass, value, SIMD_LOAD(pixel+channelstride*i)));
+							continue;
 						}
-						b2 = 1-b1;
-						// calculate the actual point
-						double x = cvertex[0]*b2+nvertex[0]*b1;
-						double y = cvertex[1]*b2+nvertex[1]*b1;
-						double z = cvertex[2]*b2+nvertex[2]*b1;
-						double w = cvertex[3]*b2+nvertex[3]*b1;
-						// test to see if point is clipped (ORs are due to floating point not to be trusted)
-						if(x < -w && j!=0) continue;
-						else if(x > w && j!=1) continue;
-						if(y < -w && j!=2) continue;
-						else if(y > w && j!=3) continue;
-						if(z < -w && j!=4) continue;
-						else if(z > w && j!=5) continue;
-						// the point is valid, not clipped, to be put in buffer
-						coordinates[index][0] = x;
-						coordinates[index][1] = y;
-						coordinates[index][2] = z;
-						coordinates[index][3] = w;
-						barycentric[index][i] = b2;
-						barycentric[index][(i+1)%3] = b1;
-						barycentric[index][(i+2)%3] = 0;
-						index++;
-						tvalues[tindex] == b1;
-						tindex++;
-						// prevent degeneracy from causing tindex out of bounds issue
-						if(tindex == 2) break;
+						double values[SIMD_LANES];
+						SIMD_STORE(values, value);
+						for(int k = 0; k < SIMD_LANES; k++) if(mask >> k & 1) pixel[pixelstride*k+i] = values[k];
 					}
-					// optimization
-					else if(!(planes >> j)) break;
 				}
-				// it's possible the vertices could have been put in out of order if edge passes through two faces of cube
-				if(tindex == 2 && tvalues[0] > tvalues[1])
-				{
-					double temp[4];
-					memcpy(temp, coordinates[index-1], 4*sizeof(double));
-					memcpy(coordinates[index-1], coordinates[index-2], 4*sizeof(double));
-					memcpy(coordinates[index-2], temp, 4*sizeof(double));
-					memcpy(temp, barycentric[index-1], 3*sizeof(double));
-					memcpy(barycentric[index-1], barycentric[index-2], 4*sizeof(double));
-					memcpy(barycentric[index-2], temp, 4*sizeof(double));
-				}
-			}
-			// now the buffer has all the information needed to construct the final triangle mesh
-			// easier to do this by splitting the loop up into a first case then subsequent cases
-			memcpy(wtriangle, coordinates[0], 12*sizeof(double));
-			wtriangle += 12;
-			// pointer to attributes for first vertex (for reuse)
-			double *attrib0 = wtriangle;
-			for(int i = 0; i < 3; i++)
-			{
-				/*double winterp =
-					barycentric[i][0] / ctriangle[3] +
-					barycentric[i][1] / ctriangle[7] +
-					barycentric[i][2] / ctriangle[11];*/
-				for(int j = 0; j < attributes; j++)
-				{
-					/**wtriangle = (
-						ctriangle[12+j] * barycentric[i][0] / ctriangle[3] +
-						ctriangle[12+j+attributes] * barycentric[i][1] / ctriangle[7] +
-						ctriangle[12+j+2*attributes]  * barycentric[i][2] / ctriangle[11]) / winterp;*/
-					*wtriangle =
-						ctriangle[12+j] * barycentric[i][0] +
-						ctriangle[12+j+attributes] * barycentric[i][1] +
-						ctriangle[12+j+2*attributes] * barycentric[i][2];
-					wtriangle++;
-				}
-			}
-			memcpy(wtriangle, ctriangle+statoff, statics*sizeof(double));
-			wtriangle += statics;
-			written++;
-			if(written == capacity) return capacity;
-			for(int i = 2; i < index-1; i++)
-			{
-				memcpy(wtriangle, coordinates[0], 4*sizeof(double));
-				wtriangle += 4;
-				memcpy(wtriangle, coordinates[i], 8*sizeof(double));
-				wtriangle += 8;
-				memcpy(wtriangle, attrib0, attributes*sizeof(double));
-				wtriangle += attributes;
-				memcpy(wtriangle, wtriangle-pitch+attributes, attributes*sizeof(double));
-				wtriangle += attributes;
-				/*double winterp =
-					barycentric[i+1][0] / ctriangle[3] +
-					barycentric[i+1][1] / ctriangle[7] +
-					barycentric[i+1][2] / ctriangle[11];*/
-				for(int j = 0; j < attributes; j++)
+#endif
+				for(; x < x1; x++)
 				{
-					/**wtriangle = (
-						ctriangle[12+j] * barycentric[i+1][0] / ctriangle[3] +
-						ctriangle[12+j+attributes] * barycentric[i+1][1] / ctriangle[7] +
-						ctriangle[12+j+2*attributes]  * barycentric[i+1][2] / ctriangle[11]) / winterp;*/
-					*wtriangle =
-						ctriangle[12+j] * barycentric[i+1][0] +
-						ctriangle[12+j+attributes] * barycentric[i+1][1] +
-						ctriangle[12+j+2*attributes]  * barycentric[i+1][2];
-					wtriangle++;
+					if(e0 >= bias[0] && e1 >= bias[1] && e2 >= bias[2])
+					{
+						double dx = x-setup->left;
+						double z = setup->zw[0]*dx+rowz;
+						int pass;
+						if(plain)
+						{
+							pass = accept || z >= zbuff[x+width*y];
+							if(pass) zbuff[x+width*y] = z;
+						}
+						else pass = FramebufferDepthTest(framebuffer, x+width*y, z, accept);
+						if(pass)
+						{
+							written = 1;
+							double w = 1.0/(setup->winv[0]*dx+rowwinv);
+							if(vbuff)
+							{
+								GCORE_Visibility *record = vbuff+x+width*y;
+								record->triangle = index;
+								record->b1 = (setup->weights[0][0]*dx+rowb1)*w;
+								record->b2 = (setup->weights[1][0]*dx+rowb2)*w;
+							}
+							else if(!plain)
+							{
+								for(int i = 0; i < attributes; i++) FramebufferWrite(framebuffer, x+width*y, i, (setup->attributes[3*i]*dx+rowattrs[i])*w);
+								for(int i = 0; i < statics; i++) FramebufferWrite(framebuffer, x+width*y, attributes+i, stats[i]);
+							}
+							else
+							{
+								double *pixel = abuff+pixelstride*(x+width*y);
+								for(int i = 0; i < attributes; i++) pixel[channelstride*i] = (setup->attributes[3*i]*dx+rowattrs[i])*w;
+								for(int i = 0; i < statics; i++) pixel[channelstride*(attributes+i)] = stats[i];
+							}
+						}
+					}
+					e0 += stepx[0];
+					e1 += stepx[1];
+					e2 += stepx[2];
 				}
-				memcpy(wtriangle, ctriangle+statoff, statics*sizeof(double));
-				wtriangle += statics;
-				written++;
-				if(written == capacity) return capacity;
+				block[0] += stepy[0];
+				block[1] += stepy[1];
+				block[2] += stepy[2];
 			}
+			if(hiz && written) DepthHierarchyUpdate(hiz, framebuffer, hizindex);
+		}
+	}
+}
+
+// rasterizes one triangle within a scissor rectangle
+typedef void (*TriangleKernel)(GCORE_TriangleSetup *setup, int index, int attributes, int statics, GCORE_Framebuffer *framebuffer, int left, int top, int right, int bottom);
+
+// work shared between the threads rasterizing the tiles of one call
+typedef struct
+{
+	GCORE_TriangleRasterizer *rasterizer;
+	TriangleKernel kernel;
+	int attributes;
+	int statics;
+	GCORE_Framebuffer *framebuffer;
+	int columns;
+	mtx_t lock;
+	int next;
+} TileJob;
+
+int TileWorker(void *arg)
+{
+	TileJob *job = arg;
+	GCORE_TriangleRasterizer *rasterizer = job->rasterizer;
+	int tilesize = rasterizer->tilesize;
+	for(;;)
+	{
+		mtx_lock(&job->lock);
+		int tile = job->next++;
+		mtx_unlock(&job->lock);
+		if(tile >= rasterizer->tilecount) break;
+		int left = (tile%job->columns)*tilesize;
+		int top = (tile/job->columns)*tilesize;
+		int right = left+tilesize < job->framebuffer->width ? left+tilesize : job->framebuffer->width;
+		int bottom = top+tilesize < job->framebuffer->height ? top+tilesize : job->framebuffer->height;
+		// bins hold triangles in submission order, so each pixel sees the same sequence of depth tests as the serial path
+		int *bin = rasterizer->bins[tile];
+		for(int i = 0; i < rasterizer->binsizes[tile]; i++)
+		{
+			job->kernel(&rasterizer->setups[bin[i]], bin[i], job->attributes, job->statics, job->framebuffer, left, top, right, bottom);
+		}
+	}
+	return 0;
+}
+
+// the geometry stages for triangle buffers of doubles
+#define REAL double
+#define REAL_NAME(name) name
+#include "gcorereal.h"
+#undef REAL
+#undef REAL_NAME
+
+// and of floats, for pipelines where single precision geometry is enough
+#define REAL float
+#define REAL_NAME(name) name##F
+#include "gcorereal.h"
+#undef REAL
+#undef REAL_NAME
+
+void GCORE_TriangleClipperInitialize(GCORE_TriangleClipper *clipper, double *buffin, int attributes, int statics, int count, double guardband)
+{
+	clipper->buffin = buffin;
+	clipper->attributes = attributes;
+	clipper->statics = statics;
+	clipper->count = count;
+	clipper->guardband = guardband;
+	clipper->consumed = 0;
+	clipper->overflow = malloc((size_t)CLIP_FAN*(12+3*attributes+statics)*sizeof(double));
+	clipper->overflowcount = 0;
+}
+
+int GCORE_TriangleClipperClip(GCORE_TriangleClipper *clipper, double *buffout, int capacity)
+{
+	// number of doubles in a triangle
+	int pitch = 12+3*clipper->attributes+clipper->statics;
+	// triangles left over from a fan that did not fit last time go out first
+	int written = clipper->overflowcount < capacity ? clipper->overflowcount : capacity;
+	memcpy(buffout, clipper->overflow, (size_t)pitch*written*sizeof(double));
+	memmove(clipper->overflow, clipper->overflow+(size_t)pitch*written, (size_t)pitch*(clipper->overflowcount-written)*sizeof(double));
+	clipper->overflowcount -= written;
+	if(written == capacity) return capacity;
+	return written + ClipStream(clipper->buffin, clipper->attributes, clipper->statics, clipper->consumed, clipper->count,
+		buffout+(size_t)pitch*written, capacity-written, clipper->guardband, &clipper->consumed, clipper->overflow, &clipper->overflowcount);
+}
+
+void GCORE_TriangleClipperClean(GCORE_TriangleClipper *clipper)
+{
+	free(clipper->overflow);
+}
+
+// number of triangles per chunk of the parallel clipper, each chunk clipped by one thread into its own buffer
+#define CLIP_CHUNK 4096
+
+// work shared between the threads clipping the chunks of one call
+typedef struct
+{
+	double *buffin;
+	int attributes;
+	int statics;
+	int count;
+	double guardband;
+	int chunks;
+	double **outputs;
+	int *sizes;
+	int *offsets;
+	double *buffout;
+	int capacity;
+	mtx_t lock;
+	int next;
+} ClipJob;
+
+int ClipWorker(void *arg)
+{
+	ClipJob *job = arg;
+	// number of doubles in a triangle
+	int pitch = 12+3*job->attributes+job->statics;
+	for(;;)
+	{
+		mtx_lock(&job->lock);
+		int chunk = job->next++;
+		mtx_unlock(&job->lock);
+		if(chunk >= job->chunks) break;
+		int first = chunk*CLIP_CHUNK;
+		int count = job->count-first < CLIP_CHUNK ? job->count-first : CLIP_CHUNK;
+		// the output of a chunk is rarely larger than its input, the buffer doubles whenever it is not enough
+		int capacity = count;
+		int size = 0;
+		double *output = malloc((size_t)capacity*pitch*sizeof(double));
+		GCORE_TriangleClipper clipper;
+		GCORE_TriangleClipperInitialize(&clipper, job->buffin+(size_t)pitch*first, job->attributes, job->statics, count, job->guardband);
+		for(;;)
+		{
+			size += GCORE_TriangleClipperClip(&clipper, output+(size_t)pitch*size, capacity-size);
+			if(size < capacity) break;
+			capacity *= 2;
+			output = realloc(output, (size_t)capacity*pitch*sizeof(double));
 		}
-		ctriangle+=pitch;
+		GCORE_TriangleClipperClean(&clipper);
+		job->outputs[chunk] = output;
+		job->sizes[chunk] = size;
+	}
+	return 0;
+}
+
+int ClipCopyWorker(void *arg)
+{
+	ClipJob *job = arg;
+	// number of doubles in a triangle
+	int pitch = 12+3*job->attributes+job->statics;
+	for(;;)
+	{
+		mtx_lock(&job->lock);
+		int chunk = job->next++;
+		mtx_unlock(&job->lock);
+		if(chunk >= job->chunks) break;
+		// chunks past the capacity of the output buffer are dropped as the serial clipper would
+		int offset = job->offsets[chunk];
+		int size = job->sizes[chunk] < job->capacity-offset ? job->sizes[chunk] : job->capacity-offset;
+		if(size > 0) memcpy(job->buffout+(size_t)pitch*offset, job->outputs[chunk], (size_t)pitch*size*sizeof(double));
+		free(job->outputs[chunk]);
 	}
+	return 0;
+}
+
+int GCORE_ClipTrianglesParallel(double *buffin, int attributes, int statics, int count, double *buffout, int capacity, double guardband, int threads)
+{
+	int chunks = (count+CLIP_CHUNK-1)/CLIP_CHUNK;
+	ClipJob job = {.buffin = buffin, .attributes = attributes, .statics = statics, .count = count, .guardband = guardband, .chunks = chunks,
+		.outputs = malloc(chunks*sizeof(double*)), .sizes = malloc(chunks*sizeof(int)), .offsets = malloc(chunks*sizeof(int)),
+		.buffout = buffout, .capacity = capacity, .next = 0};
+	mtx_init(&job.lock, mtx_plain);
+	WORKERS_Run(ClipWorker, &job, threads);
+	// exclusive prefix sum of the chunk sizes places the chunks contiguously in submission order
+	int written = 0;
+	for(int i = 0; i < job.chunks; i++)
+	{
+		job.offsets[i] = written;
+		written = job.sizes[i] < capacity-written ? written+job.sizes[i] : capacity;
+	}
+	job.next = 0;
+	WORKERS_Run(ClipCopyWorker, &job, threads);
+	mtx_destroy(&job.lock);
+	free(job.outputs);
+	free(job.sizes);
+	free(job.offsets);
 	return written;
 }
 
-int GCORE_TransformTriangles(double *buff, int attributes, int statics, int count, int anormal, int snormal, M3D_Matrix *world, M3D_Matrix *view, M3D_Matrix *projection)
+// number of triangles of a mesh transformed for every instance before moving on to the next
+#define TRANSFORM_BLOCK 256
+
+int GCORE_TransformTrianglesInstanced(double *buffin, int attributes, int statics, int count, int anormal, int snormal, double *worlds, int worldstride, int instances, M3D_Matrix *view, M3D_Matrix *projection, double *buffout)
+{
+	// number of doubles per triangle
+	int pitch = 12+3*attributes+statics;
+	worldstride = worldstride ? worldstride : 16;
+	// the coordinate and normal transforms of every instance, made up front with the view and projection combined once
+	M3D_Matrix *coordtrans = malloc(2*(size_t)instances*sizeof(M3D_Matrix));
+	M3D_Matrix *normtrans = coordtrans+instances;
+	M3D_Matrix viewproj;
+	M3D_Multiply(projection, view, &viewproj);
+	for(int k = 0; k < instances; k++)
+	{
+		M3D_Matrix *world = (M3D_Matrix*)(worlds+(size_t)worldstride*k);
+		M3D_NormalMatrix(world, &normtrans[k]);
+		M3DI_Multiply(&viewproj, world, &coordtrans[k]);
+	}
+	// a block of the mesh stays in cache while it is copied out and transformed for every instance
+	for(int first = 0; first < count; first += TRANSFORM_BLOCK)
+	{
+		int size = count-first < TRANSFORM_BLOCK ? count-first : TRANSFORM_BLOCK;
+		double *block = buffin+(size_t)pitch*first;
+		for(int k = 0; k < instances; k++)
+		{
+			double *wblock = buffout+(size_t)pitch*((size_t)count*k+first);
+			memcpy(wblock, block, (size_t)pitch*size*sizeof(double));
+			TransformStreams(wblock, attributes, statics, size, anormal, snormal, &coordtrans[k], &normtrans[k]);
+		}
+	}
+	free(coordtrans);
+	return instances*count;
+}
+
+int GCORE_TransformIndexedTriangles(double *vertices, int attributes, double *statbuff, int statics, int *indices, int count, int anormal, int snormal, M3D_Matrix *world, M3D_Matrix *view, M3D_Matrix *projection, double *buffout)
 {
-	// pointer to current triangle
-	double *ctriangle = buff;
+	// pointer to location in output buffer for next triangle
+	double *wtriangle = buffout;
 	// number of doubles per triangle
 	int pitch = 12+3*attributes+statics;
+	// number of doubles per vertex
+	int stride = 4+attributes;
 	// normal transform
 	M3D_Matrix normtrans;
 	// coordinate transform
 	M3D_Matrix coordtrans;
-	// temporary matrix
-	M3D_Matrix temp;
-	M3D_InverseTranspose(world, &normtrans);
-	M3D_Multiply(view, world, &temp);
-	M3D_Multiply(projection, &temp, &coordtrans);
+	M3D_NormalMatrix(world, &normtrans);
+	M3DI_Multiply3(projection, view, world, &coordtrans);
+	// first in first out cache of transformed vertices, tagged with their indices
+	int tags[GCORE_VERTEXCACHE];
+	double cache[GCORE_VERTEXCACHE][stride];
+	int oldest = 0;
+	int transformed = 0;
+	for(int i = 0; i < GCORE_VERTEXCACHE; i++) tags[i] = -1;
 	for(int n = 0; n < count; n++)
 	{
-		// temporary holding space for coordinates
-		M3D_Vector temp1[4];
-		memcpy(temp1, ctriangle, 12*sizeof(double));
 		for(int i = 0; i < 3; i++)
 		{
-			M3D_Transform(&coordtrans, &temp1[i], (M3D_Vector*)(ctriangle+4*i));
+			int index = indices[3*n+i];
+			int slot = 0;
+			while(slot < GCORE_VERTEXCACHE && tags[slot] != index) slot++;
+			// a miss transforms the vertex into the slot of the oldest
+			if(slot == GCORE_VERTEXCACHE)
+			{
+				slot = oldest;
+				oldest = (oldest+1)%GCORE_VERTEXCACHE;
+				tags[slot] = index;
+				double *cvertex = vertices+(size_t)stride*index;
+				M3D_TransformPoints(&coordtrans, cvertex, stride, 1, cache[slot], stride);
+				memcpy(cache[slot]+4, cvertex+4, attributes*sizeof(double));
+				if(anormal != -1) M3D_TransformDirections(&normtrans, cvertex+4+anormal, stride, 1, cache[slot]+4+anormal, stride);
+				transformed++;
+			}
+			memcpy(wtriangle+4*i, cache[slot], 4*sizeof(double));
+			memcpy(wtriangle+12+attributes*i, cache[slot]+4, attributes*sizeof(double));
 		}
-		// temporary holding space for normal
-		M3D_Vector temp2;
-		if(snormal != -1)
+		if(statics) memcpy(wtriangle+12+3*attributes, statbuff+(size_t)statics*n, statics*sizeof(double));
+		if(snormal != -1) M3D_TransformDirections(&normtrans, wtriangle+12+3*attributes+snormal, pitch, 1, wtriangle+12+3*attributes+snormal, pitch);
+		wtriangle += pitch;
+	}
+	return transformed;
+}
+
+// number of doubles per bone of a skinning palette, the columns of its coordinate transform then the three columns of its normal matrix
+#define SKIN_PITCH 28
+// number of vertices skinned or triangles assembled per chunk of a skinning pass
+#define SKIN_CHUNK 1024
+
+// work shared between the threads skinning one mesh
+typedef struct
+{
+	double *vertices;
+	int attributes;
+	double *statbuff;
+	int statics;
+	int *indices;
+	int count;
+	int *bones;
+	double *weights;
+	int vcount;
+	int anormal;
+	double *palette;
+	double *skinned;
+	double *buffout;
+	mtx_t lock;
+	int next;
+} SkinJob;
+
+// applies the transforms of a vertex's bones to a vector and blends the results by the bones' weights
+// takes the palette, the offset of the transform within each bone's doubles, the vertex's bones and weights,
+// the vector and its number of components, and the result (4 components)
+void SkinBlend(double *palette, int offset, int *bones, double *weights, double *vector, int components, double *result)
+{
+#ifdef SIMD_LANES
+	for(int h = 0; h < 4; h += SIMD_LANES)
+	{
+		SIMD_Double sum = SIMD_SET(0.0);
+		for(int k = 0; k < GCORE_SKINBONES; k++)
 		{
-			memcpy(temp2, ctriangle+snormal, 3*sizeof(double));
-			temp2[3] = 0;
-			M3D_Transform(&normtrans, &temp2, (M3D_Vector*)(ctriangle+snormal));
+			if(weights[k] == 0) continue;
+			double *columns = palette+SKIN_PITCH*bones[k]+offset;
+			SIMD_Double transformed = SIMD_MUL(SIMD_LOAD(columns+h), SIMD_SET(vector[0]));
+			for(int c = 1; c < components; c++) transformed = SIMD_ADD(transformed, SIMD_MUL(SIMD_LOAD(columns+4*c+h), SIMD_SET(vector[c])));
+			sum = SIMD_ADD(sum, SIMD_MUL(SIMD_SET(weights[k]), transformed));
 		}
-		if(anormal != -1)
+		SIMD_STORE(result+h, sum);
+	}
+#else
+	for(int h = 0; h < 4; h++)
+	{
+		double sum = 0.0;
+		for(int k = 0; k < GCORE_SKINBONES; k++)
 		{
-			for(int i = 0; i < 3; i++)
-			{
-				int offset = anormal+attributes*i;
-				memcpy(temp2, ctriangle+offset, 3*sizeof(double));
-				temp2[3] = 0;
-				M3D_Transform(&normtrans, &temp2, (M3D_Vector*)(ctriangle+offset));
-			}
+			if(weights[k] == 0) continue;
+			double *columns = palette+SKIN_PITCH*bones[k]+offset;
+			double transformed = columns[h]*vector[0];
+			for(int c = 1; c < components; c++) transformed += columns[4*c+h]*vector[c];
+			sum += weights[k]*transformed;
 		}
-		ctriangle += pitch;
+		result[h] = sum;
 	}
+#endif
 }
 
-void GCORE_TriangleRaster(double *buff, int attributes, int statics, int count, double *zbuff, double *abuff, int width, int height)
+int SkinWorker(void *arg)
 {
-	// pointer to current triangle
-	double *ctriangle = buff;
-	// number of doubles per triangle
-	int pitch = 12+3*attributes+statics;
-	for(int n = 0; n < count; n++)
+	SkinJob *job = arg;
+	int stride = 4+job->attributes;
+	for(;;)
 	{
-		double ytmp[] = {0.5*(height*ctriangle[1]/ctriangle[3]+height), 0.5*(height*ctriangle[5]/ctriangle[7]+height), 0.5*(height*ctriangle[9]/ctriangle[11]+height)};
-		double *verts[3];
-		double *attrs[3];
-		double xvals[3];
-		double yvals[3];
-		int ycut[3];
-		for(int i = 0; i < 3; i++)
+		mtx_lock(&job->lock);
+		int first = SKIN_CHUNK*job->next++;
+		mtx_unlock(&job->lock);
+		if(first >= job->vcount) break;
+		int last = first+SKIN_CHUNK < job->vcount ? first+SKIN_CHUNK : job->vcount;
+		for(int v = first; v < last; v++)
 		{
-			int ind = 0;
-			for(int j = 0; j < 3; j++)
+			double *cvertex = job->vertices+(size_t)stride*v;
+			double *wvertex = job->skinned+(size_t)stride*v;
+			int *bones = job->bones+GCORE_SKINBONES*v;
+			double *weights = job->weights+GCORE_SKINBONES*v;
+			SkinBlend(job->palette, 0, bones, weights, cvertex, 4, wvertex);
+			memcpy(wvertex+4, cvertex+4, job->attributes*sizeof(double));
+			if(job->anormal != -1)
 			{
-				if(i > j && ytmp[j] <= ytmp[i]) ind++;
-				else if(i < j && ytmp[j] < ytmp[i]) ind++;
+				double normal[4];
+				SkinBlend(job->palette, 16, bones, weights, cvertex+4+job->anormal, 3, normal);
+				memcpy(wvertex+4+job->anormal, normal, 3*sizeof(double));
 			}
-			verts[ind] = ctriangle + 4*i;
-			attrs[ind] = ctriangle + 12 + attributes*i;
-			xvals[ind] = 0.5*(width*verts[ind][0]/verts[ind][3]+width);
-			ycut[ind] = round(yvals[ind] = ytmp[i]);
 		}
-		for(int y = ycut[0]; y < ycut[2]; y++)
+	}
+	return 0;
+}
+
+int SkinAssembleWorker(void *arg)
+{
+	SkinJob *job = arg;
+	int pitch = 12+3*job->attributes+job->statics;
+	int stride = 4+job->attributes;
+	for(;;)
+	{
+		mtx_lock(&job->lock);
+		int first = SKIN_CHUNK*job->next++;
+		mtx_unlock(&job->lock);
+		if(first >= job->count) break;
+		int last = first+SKIN_CHUNK < job->count ? first+SKIN_CHUNK : job->count;
+		for(int n = first; n < last; n++)
 		{
-			double t0 = (double)(y-ycut[0])/(ycut[2]-ycut[0]);
-			int cmp = ycut[2] == ycut[1] ? 0 : ycut[1] == ycut[0] ? 1 : y > ycut[1];
-			double t1 = cmp ? (double)(y-ycut[1])/(ycut[2]-ycut[1]) : (double)(y-ycut[0])/(ycut[1]-ycut[0]);
-			double xstart = xvals[0]*(1-t0)+xvals[2]*t0;
-			double xend = cmp ? xvals[1]*(1-t1)+xvals[2]*t1 : xvals[0]*(1-t1)+xvals[1]*t1;
-			double *vert0, *vert1, *attr0, *attr1;
-			if(cmp)
-			{
-				vert0 = verts[1];
-				vert1 = verts[2];
-				attr0 = attrs[1];
-				attr1 = attrs[2];
-			}
-			else
+			double *wtriangle = job->buffout+(size_t)pitch*n;
+			for(int i = 0; i < 3; i++)
 			{
-				vert0 = verts[0];
-				vert1 = verts[1];
-				attr0 = attrs[0];
-				attr1 = attrs[1];
+				double *svertex = job->skinned+(size_t)stride*job->indices[3*n+i];
+				memcpy(wtriangle+4*i, svertex, 4*sizeof(double));
+				memcpy(wtriangle+12+job->attributes*i, svertex+4, job->attributes*sizeof(double));
 			}
-			for(int x = round(xstart<xend?xstart:xend); x < round(xstart<xend?xend:xstart); x++)
+			if(job->statics) memcpy(wtriangle+12+3*job->attributes, job->statbuff+(size_t)job->statics*n, job->statics*sizeof(double));
+		}
+	}
+	return 0;
+}
+
+int GCORE_SkinTriangles(double *vertices, int attributes, double *statbuff, int statics, int *indices, int count, int *bones, double *weights, int vcount, int anormal, M3D_Matrix *palette, int bonecount, M3D_Matrix *view, M3D_Matrix *projection, double *buffout, int threads)
+{
+	// each bone's matrices, combined with the view and projection once and stored by column so a vertex blends whole columns
+	double *columns = malloc((size_t)bonecount*SKIN_PITCH*sizeof(double));
+	for(int b = 0; b < bonecount; b++)
+	{
+		M3D_Matrix coordtrans;
+		M3D_Matrix normtrans;
+		M3DI_Multiply3(projection, view, &palette[b], &coordtrans);
+		M3D_NormalMatrix(&palette[b], &normtrans);
+		double *bone = columns+SKIN_PITCH*b;
+		for(int c = 0; c < 4; c++)
+		{
+			for(int r = 0; r < 4; r++) bone[4*c+r] = coordtrans[r][c];
+		}
+		for(int c = 0; c < 3; c++)
+		{
+			for(int r = 0; r < 3; r++) bone[16+4*c+r] = normtrans[r][c];
+			bone[16+4*c+3] = 0;
+		}
+	}
+	// vertices are skinned once each, then gathered into triangles
+	double *skinned = malloc((size_t)vcount*(4+attributes)*sizeof(double));
+	SkinJob job = {.vertices = vertices, .attributes = attributes, .statbuff = statbuff, .statics = statics, .indices = indices, .count = count,
+		.bones = bones, .weights = weights, .vcount = vcount, .anormal = anormal, .palette = columns, .skinned = skinned, .buffout = buffout, .next = 0};
+	mtx_init(&job.lock, mtx_plain);
+	WORKERS_Run(SkinWorker, &job, threads);
+	job.next = 0;
+	WORKERS_Run(SkinAssembleWorker, &job, threads);
+	mtx_destroy(&job.lock);
+	free(skinned);
+	free(columns);
+	return count;
+}
+
+void GCORE_TriangleRasterizerInitialize(GCORE_TriangleRasterizer *rasterizer, int threads, int tilesize, int flags)
+{
+	rasterizer->flags = flags;
+	rasterizer->threads = threads > 0 ? threads : 1;
+	// tiles are whole depth hierarchy blocks so threads never share a block
+	tilesize = tilesize > 0 ? tilesize : GCORE_TILESIZE;
+	rasterizer->tilesize = (tilesize+GCORE_DEPTHBLOCK-1)/GCORE_DEPTHBLOCK*GCORE_DEPTHBLOCK;
+	rasterizer->hierarchy = NULL;
+	rasterizer->tilecount = 0;
+	rasterizer->tilecapacity = 0;
+	rasterizer->binsizes = NULL;
+	rasterizer->bincapacities = NULL;
+	rasterizer->bins = NULL;
+	rasterizer->setupcapacity = 0;
+	rasterizer->planecapacity = 0;
+	rasterizer->setups = NULL;
+	rasterizer->planes = NULL;
+}
+
+void GCORE_TriangleRasterizerRaster(GCORE_TriangleRasterizer *rasterizer, double *buff, int attributes, int statics, int count, double *zbuff, double *abuff, int width, int height)
+{
+	GCORE_Framebuffer framebuffer;
+	FramebufferWrap(&framebuffer, zbuff, abuff, NULL, attributes+statics, width, height, rasterizer->hierarchy);
+	GCORE_TriangleRasterizerRasterFramebuffer(rasterizer, buff, attributes, statics, count, &framebuffer);
+}
+
+void GCORE_TriangleRasterizerVisibility(GCORE_TriangleRasterizer *rasterizer, double *buff, int attributes, int statics, int count, double *zbuff, GCORE_Visibility *vbuff, int width, int height)
+{
+	GCORE_Framebuffer framebuffer;
+	FramebufferWrap(&framebuffer, zbuff, NULL, vbuff, attributes+statics, width, height, rasterizer->hierarchy);
+	GCORE_TriangleRasterizerRasterFramebuffer(rasterizer, buff, attributes, statics, count, &framebuffer);
+}
+
+void GCORE_VisibilityClear(GCORE_Visibility *vbuff, int width, int height)
+{
+	for(int i = 0; i < width*height; i++)
+	{
+		vbuff[i].triangle = -1;
+		vbuff[i].b1 = 0;
+		vbuff[i].b2 = 0;
+	}
+}
+
+void GCORE_VisibilityResolve(double *buff, int attributes, int statics, GCORE_Visibility *vbuff, double *abuff, int width, int height)
+{
+	// number of doubles per triangle
+	int pitch = 12+3*attributes+statics;
+	int channels = attributes+statics;
+	for(int i = 0; i < width*height; i++)
+	{
+		if(vbuff[i].triangle < 0) continue;
+		double *ctriangle = buff+pitch*vbuff[i].triangle;
+		double b1 = vbuff[i].b1;
+		double b2 = vbuff[i].b2;
+		double b0 = 1-b1-b2;
+		double *pixel = abuff+channels*i;
+		for(int j = 0; j < attributes; j++) pixel[j] = ctriangle[12+j]*b0+ctriangle[12+attributes+j]*b1+ctriangle[12+2*attributes+j]*b2;
+		memcpy(pixel+attributes, ctriangle+12+3*attributes, statics*sizeof(double));
+	}
+}
+
+void GCORE_TriangleRasterizerClean(GCORE_TriangleRasterizer *rasterizer)
+{
+	for(int i = 0; i < rasterizer->tilecapacity; i++) free(rasterizer->bins[i]);
+	free(rasterizer->binsizes);
+	free(rasterizer->bincapacities);
+	free(rasterizer->bins);
+	free(rasterizer->setups);
+	free(rasterizer->planes);
+	rasterizer->tilecount = 0;
+	rasterizer->tilecapacity = 0;
+	rasterizer->binsizes = NULL;
+	rasterizer->bincapacities = NULL;
+	rasterizer->bins = NULL;
+	rasterizer->setupcapacity = 0;
+	rasterizer->planecapacity = 0;
+	rasterizer->setups = NULL;
+	rasterizer->planes = NULL;
+}
+
+void GCORE_VisibilityResolveFramebuffer(double *buff, int attributes, int statics, GCORE_Framebuffer *framebuffer)
+{
+	// number of doubles per triangle
+	int pitch = 12+3*attributes+statics;
+	GCORE_Visibility *vbuff = framebuffer->vbuff;
+	for(int i = 0; i < framebuffer->width*framebuffer->height; i++)
+	{
+		if(vbuff[i].triangle < 0) continue;
+		double *ctriangle = buff+pitch*vbuff[i].triangle;
+		double b1 = vbuff[i].b1;
+		double b2 = vbuff[i].b2;
+		double b0 = 1-b1-b2;
+		for(int j = 0; j < attributes; j++) FramebufferWrite(framebuffer, i, j, ctriangle[12+j]*b0+ctriangle[12+attributes+j]*b1+ctriangle[12+2*attributes+j]*b2);
+		for(int j = 0; j < statics; j++) FramebufferWrite(framebuffer, i, attributes+j, ctriangle[12+3*attributes+j]);
+	}
+}
+
+void GCORE_DrawTriangles(GCORE_BufferPool *pool, double *buffin, int attributes, int statics, int count, int anormal, int snormal, M3D_Matrix *world, M3D_Matrix *view, M3D_Matrix *projection, double guardband, int cullflags, GCORE_CullCounts *counts, GCORE_TriangleRasterizer *rasterizer, GCORE_Framebuffer *framebuffer)
+{
+	// number of doubles per triangle
+	int pitch = 12+3*attributes+statics;
+	// number of triangles a buffer of the pool holds, the size of every chunk
+	int chunk = pool->buffersize/(pitch*(int)sizeof(double));
+	// normal transform
+	M3D_Matrix normtrans;
+	// coordinate transform
+	M3D_Matrix coordtrans;
+	M3D_NormalMatrix(world, &normtrans);
+	M3DI_Multiply3(projection, view, world, &coordtrans);
+	// one buffer holds the transformed chunk, the other the clipped triangles on their way to the rasterizer
+	GCORE_Buffer *transformed = GCORE_BufferPoolAcquire(pool);
+	GCORE_Buffer *clipped = GCORE_BufferPoolAcquire(pool);
+	double *tbuff = transformed->content;
+	double *cbuff = clipped->content;
+	if(counts) counts->facing = counts->degenerate = counts->empty = 0;
+	for(int first = 0; first < count; first += chunk)
+	{
+		int size = count-first < chunk ? count-first : chunk;
+		memcpy(tbuff, buffin+(size_t)pitch*first, (size_t)pitch*size*sizeof(double));
+		TransformStreams(tbuff, attributes, statics, size, anormal, snormal, &coordtrans, &normtrans);
+		// the clipper resumes until the chunk is used up, the clipped triangles keep their order so every pixel sees the same depth tests
+		GCORE_TriangleClipper clipper;
+		GCORE_TriangleClipperInitialize(&clipper, tbuff, attributes, statics, size, guardband);
+		int written;
+		do
+		{
+			written = GCORE_TriangleClipperClip(&clipper, cbuff, chunk);
+			GCORE_CullCounts culled;
+			int kept = GCORE_CullTriangles(cbuff, attributes, statics, written, framebuffer->width, framebuffer->height, cullflags, &culled);
+			if(counts)
 			{
-				//if(y < 0 || y >= height || x < 0 || x >= width) continue;
-				double t2 = (x-xstart)/(xend-xstart);
-				double winterp = ((1-t0)/verts[0][3]+t0/verts[2][3])*(1-t2)+((1-t1)/vert0[3]+t1/vert1[3])*t2;
-				double z = (((1-t0)*verts[0][2]/verts[0][3]+t0*verts[2][2]/verts[2][3])*(1-t2)+((1-t1)*vert0[2]/vert0[3]+t1*vert1[2]/vert1[3])*t2);
-				if(z < zbuff[x+width*y]) continue;
-				zbuff[x+width*y] = z;
-				for(int i = 0; i < attributes; i++)
-				{
-					abuff[(attributes+statics)*x+(attributes+statics)*width*y+i] = ((attrs[0][i]*(1-t0)/verts[0][3]+attrs[2][i]*t0/verts[2][3])*(1-t2)+(attr0[i]*(1-t1)/vert0[3]+attr1[i]*t1/vert1[3])*t2)/winterp;
-				}
-				memcpy(&abuff[(attributes+statics)*x+(attributes+statics)*width*y+attributes],ctriangle+12+3*attributes,statics*sizeof(double));
+				counts->facing += culled.facing;
+				counts->degenerate += culled.degenerate;
+				counts->empty += culled.empty;
 			}
-		}
-		ctriangle += pitch;
+			if(rasterizer) GCORE_TriangleRasterizerRasterFramebuffer(rasterizer, cbuff, attributes, statics, kept, framebuffer);
+			else GCORE_TriangleRasterFramebuffer(cbuff, attributes, statics, kept, framebuffer);
+		} while(written == chunk);
+		GCORE_TriangleClipperClean(&clipper);
 	}
+	GCORE_BufferRelease(transformed);
+	GCORE_BufferRelease(clipped);
 }
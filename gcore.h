@@ -13,6 +13,30 @@ All rights reserved
 #define GCORE_THREADED 1
 #define GCORE_BLOCKING 3
 
+#define GCORE_TILESIZE 64
+#define GCORE_SUBPIXEL 8
+#define GCORE_DEPTHBLOCK 8
+#define GCORE_VERTEXCACHE 32
+#define GCORE_SKINBONES 4
+
+#define GCORE_RASTER_HALFSPACE 1
+
+#define GCORE_FLOAT64 0
+#define GCORE_FLOAT32 1
+#define GCORE_FLOAT16 2
+#define GCORE_UNORM8  3
+#define GCORE_UNORM24 4
+#define GCORE_UNORM32 5
+
+#define GCORE_CULL_BACK 1
+#define GCORE_CULL_FRONT 2
+#define GCORE_CULL_CLOCKWISE 4
+#define GCORE_CULL_EMPTY 8
+
+#define GCORE_INTERLEAVED 0
+#define GCORE_PLANAR 1
+
+#include <stddef.h>
 #include <threads.h>
 #include "m3d.h"
 #include "avl.h"
@@ -84,8 +108,91 @@ typedef struct
 
 typedef struct
 {
+	double *buffin;
+	int attributes;
+	int statics;
+	int count;
+	double guardband;
+	int consumed;
+	double *overflow;
+	int overflowcount;
 } GCORE_TriangleClipper;
 
+typedef struct
+{
+	int facing;
+	int degenerate;
+	int empty;
+} GCORE_CullCounts;
+
+typedef struct
+{
+	int triangle;
+	float b1;
+	float b2;
+} GCORE_Visibility;
+
+typedef struct
+{
+	int columns;
+	int rows;
+	double *zmin;
+	double *zmax;
+} GCORE_DepthHierarchy;
+
+typedef struct
+{
+	int width;
+	int height;
+	int depthformat;
+	void *zbuff;
+	int channels;
+	int layout;
+	int *formats;
+	size_t *offsets;
+	int *strides;
+	size_t size;
+	void *abuff;
+	GCORE_Visibility *vbuff;
+	GCORE_DepthHierarchy *hierarchy;
+} GCORE_Framebuffer;
+
+typedef struct
+{
+	double *statics;
+	int left;
+	int top;
+	int right;
+	int bottom;
+	long long edge[3];
+	long long stepx[3];
+	long long stepy[3];
+	int bias[3];
+	double zmin;
+	double zmax;
+	double winv[3];
+	double zw[3];
+	double weights[2][3];
+	double *attributes;
+} GCORE_TriangleSetup;
+
+typedef struct
+{
+	int flags;
+	int threads;
+	int tilesize;
+	int tilecount;
+	int tilecapacity;
+	int *binsizes;
+	int *bincapacities;
+	int **bins;
+	int setupcapacity;
+	size_t planecapacity;
+	GCORE_TriangleSetup *setups;
+	double *planes;
+	GCORE_DepthHierarchy *hierarchy;
+} GCORE_TriangleRasterizer;
+
 void GCORE_BufferRelease(GCORE_Buffer *buffer);
 
 void GCORE_BufferReference(GCORE_Buffer *buffer, int increment);
@@ -128,19 +235,229 @@ void GCORE_IndexSubsetConstruct(GCORE_IndexSubset *indices, GCORE_ContainerDescr
 // returns the number of triangles placed in the output buffer
 int GCORE_ClipTriangles(double *buffin, int attributes, int statics, int count, double *buffout, int capacity);
 
+// clips triangles as GCORE_ClipTriangles does, but only against the near and far planes and a guard band around the x and y planes
+// triangles crossing the edges of the screen but within the guard band pass through whole and are scissored by the rasterizers
+// some triangles missing the screen can pass through too, GCORE_CullTriangles with GCORE_CULL_EMPTY removes them
+// takes the same arguments as GCORE_ClipTriangles and the extent of the guard band, 1 meaning none and 2 allowing x and y to reach twice the edges of the screen
+// the rasterizers work in fixed point, guardband times the larger of the raster's width and height should be kept below 2^18 for them to stay exact
+int GCORE_ClipTrianglesGuardBand(double *buffin, int attributes, int statics, int count, double *buffout, int capacity, double guardband);
+
+// initializes a clipper that streams the clipped triangles of an input buffer through output buffers of any capacity
+// takes a pointer to the clipper and the same arguments as GCORE_ClipTrianglesGuardBand but for the output buffer and its capacity
+// the clipper's consumed member counts the input triangles consumed so far
+void GCORE_TriangleClipperInitialize(GCORE_TriangleClipper *clipper, double *buffin, int attributes, int statics, int count, double guardband);
+
+// clips triangles into an output buffer until it is full, resuming where the last call stopped
+// triangles of a clipped triangle's fan that do not fit are held by the clipper and placed first in the next call, so nothing is dropped
+// takes a pointer to the clipper, a pointer to the output buffer, and its capacity in number of triangles
+// returns the number of triangles placed in the output buffer, less than the capacity only once the input is exhausted
+int GCORE_TriangleClipperClip(GCORE_TriangleClipper *clipper, double *buffout, int capacity);
+
+// frees the room held by a clipper for fans overflowing the output buffer
+// takes a pointer to the clipper
+void GCORE_TriangleClipperClean(GCORE_TriangleClipper *clipper);
+
+// clips triangles as GCORE_ClipTrianglesGuardBand does, with the input split into chunks clipped in parallel
+// takes the same arguments as GCORE_ClipTrianglesGuardBand and the number of threads to clip with (including the calling thread)
+// the output is identical to that of GCORE_ClipTrianglesGuardBand, in submission order
+// returns the number of triangles placed in the output buffer
+int GCORE_ClipTrianglesParallel(double *buffin, int attributes, int statics, int count, double *buffout, int capacity, double guardband, int threads);
+
 // transforms triangles in place
 // takes a pointer to the vertex buffer, the number of attributes per vertex, the number of static attributes per triangle,
 // the number of triangles in the buffer,
 // an index to the x component of the normal attribute (subsequent indices y and z) or -1 if no normal,
 // an index to the x component of the normal static or -1,
 // and matrices for the world, view, and projection transforms
+// returns the number of triangles transformed
 int GCORE_TransformTriangles(double *buff, int attributes, int statics, int count, int anormal, int snormal, M3D_Matrix *world, M3D_Matrix *view, M3D_Matrix *projection);
 
-// rasterizes triangles with a halfspace algorithm
+// transforms one mesh once for each of many world matrices, writing each instance out as a copy of the mesh
+// takes a pointer to the input vertex buffer (left untouched), the number of attributes per vertex, the number of static attributes per triangle,
+// the number of triangles in the input buffer, the normal indices as GCORE_TransformTriangles takes them,
+// a pointer to the first world matrix, the number of doubles from one world matrix to the next (0 for packed M3D_Matrix),
+// the number of instances, matrices for the view and projection transforms,
+// and a pointer to the output buffer with room for every triangle of every instance, instances following one another
+// returns the number of triangles placed in the output buffer
+int GCORE_TransformTrianglesInstanced(double *buffin, int attributes, int statics, int count, int anormal, int snormal, double *worlds, int worldstride, int instances, M3D_Matrix *view, M3D_Matrix *projection, double *buffout);
+
+// transforms indexed triangles and assembles them into a vertex buffer for clipping
+// vertices are transformed through a first in first out cache of the last GCORE_VERTEXCACHE, so a vertex shared by nearby triangles is transformed once
+// takes a pointer to the vertex array with each vertex expressed as x,y,z,w followed by its attributes, the number of attributes per vertex,
+// a pointer to the statics of each triangle (may be NULL if none), the number of static attributes per triangle,
+// a pointer to the index array with three vertex indices per triangle, the number of triangles,
+// the normal indices and matrices as GCORE_TransformTriangles takes them, and a pointer to the output buffer with room for every triangle
+// the vertex array, statics and indices are left untouched
+// returns the number of vertices transformed
+int GCORE_TransformIndexedTriangles(double *vertices, int attributes, double *statbuff, int statics, int *indices, int count, int anormal, int snormal, M3D_Matrix *world, M3D_Matrix *view, M3D_Matrix *projection, double *buffout);
+
+// skins indexed triangles by linear blending of bone transforms, transforms them, and assembles them into a vertex buffer for clipping
+// each vertex is transformed once, by the sum of the transforms of up to GCORE_SKINBONES bones scaled by their weights,
+// its normal attribute by the same blend of the bones' normal matrices
+// takes the vertex array, number of attributes per vertex, statics, and indices as GCORE_TransformIndexedTriangles takes them,
+// a pointer to GCORE_SKINBONES bone indices per vertex and a pointer to as many weights per vertex (unused slots having weight 0),
+// the number of vertices, the index to the x component of the normal attribute or -1 if no normal,
+// a pointer to the palette of bone matrices (each mapping the bind pose to world space) and the number of bones,
+// matrices for the view and projection transforms, a pointer to the output buffer with room for every triangle,
+// and the number of threads to skin with (including the calling thread)
+// statics are copied untouched, having no bones of their own
+// vectorized as the halfspace rasterizer is, the results are the same either way
+// returns the number of triangles placed in the output buffer
+int GCORE_SkinTriangles(double *vertices, int attributes, double *statbuff, int statics, int *indices, int count, int *bones, double *weights, int vcount, int anormal, M3D_Matrix *palette, int bonecount, M3D_Matrix *view, M3D_Matrix *projection, double *buffout, int threads);
+
+// removes triangles which cannot be seen from a buffer of clipped triangles, compacting it in place with the order of the rest kept
+// takes a pointer to the vertex buffer, the number of attributes per vertex, the number of static attributes per triangle,
+// the number of triangles in the buffer, the width and height of the raster, flags, and a pointer to counts of the triangles culled for each reason or NULL
+// GCORE_CULL_BACK and GCORE_CULL_FRONT cull by facing, front faces winding counterclockwise in normalized device coordinates or clockwise if GCORE_CULL_CLOCKWISE is set
+// GCORE_CULL_EMPTY culls triangles which cover no pixel center under the rasterizers' fill rule
+// triangles with no area once snapped to GCORE_SUBPIXEL bits of sub-pixel precision are always culled, the rasterizers would skip them anyway
+// returns the number of triangles kept
+int GCORE_CullTriangles(double *buff, int attributes, int statics, int count, int width, int height, int flags, GCORE_CullCounts *counts);
+
+// sets up a triangle for rasterizing, computing once what every pixel of it shares
+// vertices are snapped to GCORE_SUBPIXEL bits of sub-pixel precision, giving a bounding box of pixels clipped to the raster
+// and edge functions with their steps and top-left fill rule biases, in an orientation which is the same for every triangle
+// 1/w, z/w, the perspective weights over w of vertices 2 and 3 and each attribute over w get a plane equation of three doubles,
+// the value at pixel (x,y) being plane[0]*(x-left)+plane[1]*(y-top)+plane[2], so a pixel costs adds and one reciprocal of 1/w
+// takes a pointer to the setup, a pointer to the triangle in the form given for clipping, the number of attributes per vertex,
+// the number of statics per triangle, storage for the attribute planes (3 doubles per attribute) followed by the statics copied as doubles,
+// which the setup keeps pointing to, and the width and height of the raster
+// returns 0 if the triangle has no area once snapped or lies off the raster, in which case nothing else is set, otherwise 1
+int GCORE_TriangleSetupCompute(GCORE_TriangleSetup *setup, double *triangle, int attributes, int statics, double *planes, int width, int height);
+
+// rasterizes triangles with a scanline algorithm
+// each row's span is solved from the edge functions of the triangle setup, so the same pixels are covered as by GCORE_TriangleRasterHalfspace
 // takes a pointer to the input vertex buffer, the number of attributes per vertex, the number of static attributes per triangle,
 // the number of triangles in the input buffer, a pointer to the z buffer, a pointer to the attribute buffer, and the width and height of the raster
 // triangles are expressed in the same form as given for clipping
 // the attributes buffer has the form a,b,c... u,v,w
 void GCORE_TriangleRaster(double *buff, int attributes, int statics, int count, double *zbuff, double* abuff, int width, int height);
 
+// rasterizes triangles with a halfspace (edge function) algorithm, testing the pixels of the triangle setup's bounding box in blocks
+// vertices are snapped to GCORE_SUBPIXEL bits of sub-pixel precision and pixel centers are sampled with a top-left fill rule,
+// so triangles sharing an edge neither overlap nor leave gaps
+// when built with AVX2 or SSE2 the inner loop tests, depth tests and writes 4 or 2 pixels at a time, define GCORE_SCALAR to disable this
+// takes the same arguments as GCORE_TriangleRaster
+void GCORE_TriangleRasterHalfspace(double *buff, int attributes, int statics, int count, double *zbuff, double* abuff, int width, int height);
+
+// initializes a depth hierarchy, which keeps the lowest and highest depth of each GCORE_DEPTHBLOCK square block of a z buffer
+// takes a pointer to the hierarchy and the width and height of the raster
+// the hierarchy starts out conservative (rejecting nothing) until built from the z buffer
+void GCORE_DepthHierarchyInitialize(GCORE_DepthHierarchy *hierarchy, int width, int height);
+
+// brings every block of a depth hierarchy up to date with a z buffer, to be called whenever the z buffer is cleared or written other than by a rasterizer using the hierarchy
+// takes a pointer to the hierarchy, a pointer to the z buffer, and the width and height of the raster
+void GCORE_DepthHierarchyBuild(GCORE_DepthHierarchy *hierarchy, double *zbuff, int width, int height);
+
+// frees the memory held by a depth hierarchy
+// takes a pointer to the hierarchy
+void GCORE_DepthHierarchyClean(GCORE_DepthHierarchy *hierarchy);
+
+// initializes a framebuffer and allocates its z buffer and attribute buffer
+// takes a pointer to the framebuffer, the width and height of the raster, the depth format (GCORE_FLOAT64, GCORE_FLOAT32, GCORE_UNORM24, or GCORE_UNORM32),
+// the number of channels per pixel (attributes plus statics), an array of channel formats (GCORE_FLOAT64, GCORE_FLOAT32, GCORE_FLOAT16, or GCORE_UNORM8) or NULL for all GCORE_FLOAT64,
+// and the layout of the attribute buffer, GCORE_INTERLEAVED to store the channels of each pixel together or GCORE_PLANAR to store each channel in its own contiguous plane
+// unorm depth maps [-1,1] onto the full integer range and unorm8 channels map [0,1] onto [0,255]
+// the vbuff and hierarchy members start out NULL and may be pointed at a caller owned visibility buffer and depth hierarchy
+void GCORE_FramebufferInitialize(GCORE_Framebuffer *framebuffer, int width, int height, int depthformat, int channels, int *formats, int layout);
+
+// clears depth to the farthest value and channels to zero, empties the visibility buffer and rebuilds the depth hierarchy if present
+// takes a pointer to the framebuffer
+void GCORE_FramebufferClear(GCORE_Framebuffer *framebuffer);
+
+// reads a channel of a pixel converted to double
+// takes a pointer to the framebuffer, the coordinates of the pixel, and the channel index
+// returns the value
+double GCORE_FramebufferRead(GCORE_Framebuffer *framebuffer, int x, int y, int channel);
+
+// locates a channel in the attribute buffer, for passes which walk a few channels directly in their stored format
+// takes a pointer to the framebuffer, the channel index, and a pointer to receive the distance in bytes from one pixel's value to the next
+// returns a pointer to the channel's value for the pixel at (0,0)
+void *GCORE_FramebufferChannel(GCORE_Framebuffer *framebuffer, int channel, int *stride);
+
+// reads the depth of a pixel converted to double
+// takes a pointer to the framebuffer and the coordinates of the pixel
+// returns the depth
+double GCORE_FramebufferDepth(GCORE_Framebuffer *framebuffer, int x, int y);
+
+// frees the buffers allocated by GCORE_FramebufferInitialize
+// takes a pointer to the framebuffer
+void GCORE_FramebufferClean(GCORE_Framebuffer *framebuffer);
+
+// rasterizes triangles into a framebuffer with a scanline algorithm, converting depth and channels to their formats as they are written
+// takes a pointer to the input vertex buffer, the number of attributes per vertex, the number of static attributes per triangle,
+// the number of triangles in the input buffer, and a pointer to the framebuffer
+// if the framebuffer has a visibility buffer, it is written instead of the channels
+void GCORE_TriangleRasterFramebuffer(double *buff, int attributes, int statics, int count, GCORE_Framebuffer *framebuffer);
+
+// initializes a tiled rasterizer
+// takes a pointer to the rasterizer, the number of threads to rasterize with (including the calling thread),
+// the width and height of the square screen tiles in pixels (0 for GCORE_TILESIZE, rounded up to a multiple of GCORE_DEPTHBLOCK),
+// and flags selecting the algorithm (GCORE_RASTER_HALFSPACE, otherwise scanline)
+void GCORE_TriangleRasterizerInitialize(GCORE_TriangleRasterizer *rasterizer, int threads, int tilesize, int flags);
+
+// rasterizes triangles by sorting them into screen tiles and rasterizing the tiles in parallel
+// takes a pointer to the rasterizer and otherwise the same arguments as GCORE_TriangleRaster
+// the result is identical to that of GCORE_TriangleRaster, or GCORE_TriangleRasterHalfspace if so flagged
+// if the rasterizer's hierarchy member points to a depth hierarchy of the z buffer, occluded triangles, blocks and spans are rejected early
+// and the hierarchy is kept up to date
+void GCORE_TriangleRasterizerRaster(GCORE_TriangleRasterizer *rasterizer, double *buff, int attributes, int statics, int count, double *zbuff, double *abuff, int width, int height);
+
+// rasterizes triangles into a framebuffer with a tiled rasterizer, converting depth and channels to their formats as they are written
+// takes a pointer to the rasterizer, the input vertex buffer, the number of attributes per vertex, the number of static attributes per triangle,
+// the number of triangles in the input buffer, and a pointer to the framebuffer
+// the framebuffer's depth hierarchy is used in place of the rasterizer's, and its visibility buffer if present is written instead of the channels
+void GCORE_TriangleRasterizerRasterFramebuffer(GCORE_TriangleRasterizer *rasterizer, double *buff, int attributes, int statics, int count, GCORE_Framebuffer *framebuffer);
+
+// rasterizes triangles into a visibility buffer, writing depth and for each pixel only the index of the nearest triangle
+// and the perspective correct barycentric weights of its second and third vertices
+// takes a pointer to the rasterizer, the input vertex buffer, the number of attributes per vertex, the number of static attributes per triangle,
+// the number of triangles in the input buffer, a pointer to the z buffer, a pointer to the visibility buffer, and the width and height of the raster
+// pixels no triangle reaches are left untouched
+void GCORE_TriangleRasterizerVisibility(GCORE_TriangleRasterizer *rasterizer, double *buff, int attributes, int statics, int count, double *zbuff, GCORE_Visibility *vbuff, int width, int height);
+
+// marks every pixel of a visibility buffer as empty (triangle index -1)
+// takes a pointer to the visibility buffer and the width and height of the raster
+void GCORE_VisibilityClear(GCORE_Visibility *vbuff, int width, int height);
+
+// interpolates attributes and copies statics once per pixel from the triangles recorded in a visibility buffer
+// takes a pointer to the vertex buffer the visibility buffer was rasterized from, the number of attributes per vertex, the number of static attributes per triangle,
+// a pointer to the visibility buffer, a pointer to the attribute buffer, and the width and height of the raster
+// empty pixels are left untouched
+void GCORE_VisibilityResolve(double *buff, int attributes, int statics, GCORE_Visibility *vbuff, double *abuff, int width, int height);
+
+// resolves a visibility buffer into the channels of the framebuffer holding it, converting to their formats
+// takes a pointer to the vertex buffer the visibility buffer was rasterized from, the number of attributes per vertex, the number of static attributes per triangle,
+// and a pointer to the framebuffer
+void GCORE_VisibilityResolveFramebuffer(double *buff, int attributes, int statics, GCORE_Framebuffer *framebuffer);
+
+// frees the tile bins and triangle setups held by a rasterizer
+// takes a pointer to the rasterizer
+void GCORE_TriangleRasterizerClean(GCORE_TriangleRasterizer *rasterizer);
+
+// single precision variants of the geometry stages, for pipelines where float vertex buffers are precise enough
+// each takes a buffer of floats in place of the buffer of doubles and otherwise behaves as the stage it is named after
+// clipping intersections, snapping and triangle setup are still computed in double, so rasterized coverage matches that of the same triangles held as doubles
+// depth and channels are stored in the framebuffer's formats, GCORE_FLOAT32 halving their memory as the float buffers do for geometry
+int GCORE_ClipTrianglesF(float *buffin, int attributes, int statics, int count, float *buffout, int capacity);
+int GCORE_ClipTrianglesGuardBandF(float *buffin, int attributes, int statics, int count, float *buffout, int capacity, double guardband);
+int GCORE_TransformTrianglesF(float *buff, int attributes, int statics, int count, int anormal, int snormal, M3D_Matrix *world, M3D_Matrix *view, M3D_Matrix *projection);
+int GCORE_CullTrianglesF(float *buff, int attributes, int statics, int count, int width, int height, int flags, GCORE_CullCounts *counts);
+int GCORE_TriangleSetupComputeF(GCORE_TriangleSetup *setup, float *triangle, int attributes, int statics, double *planes, int width, int height);
+void GCORE_TriangleRasterF(float *buff, int attributes, int statics, int count, double *zbuff, double* abuff, int width, int height);
+void GCORE_TriangleRasterHalfspaceF(float *buff, int attributes, int statics, int count, double *zbuff, double* abuff, int width, int height);
+void GCORE_TriangleRasterFramebufferF(float *buff, int attributes, int statics, int count, GCORE_Framebuffer *framebuffer);
+void GCORE_TriangleRasterizerRasterFramebufferF(GCORE_TriangleRasterizer *rasterizer, float *buff, int attributes, int statics, int count, GCORE_Framebuffer *framebuffer);
+
+// draws triangles into a framebuffer, transforming, clipping, culling, and rasterizing them a chunk at a time
+// chunks are as many triangles as a buffer of the pool holds, so the working set is two buffers however many triangles there are
+// takes a pointer to a buffer pool (its buffers must hold at least one triangle), a pointer to the input vertex buffer (left untouched),
+// the number of attributes per vertex, the number of static attributes per triangle, the number of triangles in the input buffer,
+// the normal indices and matrices as GCORE_TransformTriangles takes them, the guard band as GCORE_ClipTrianglesGuardBand takes it,
+// the flags and counts as GCORE_CullTriangles takes them (counts summed over all chunks),
+// a pointer to a tiled rasterizer or NULL to rasterize serially with the scanline algorithm, and a pointer to the framebuffer
+// the result is identical to that of the same stages run one after another over whole buffers
+// the framebuffer must not have a visibility buffer, as its triangle indices would refer to the chunks
+void GCORE_DrawTriangles(GCORE_BufferPool *pool, double *buffin, int attributes, int statics, int count, int anormal, int snormal, M3D_Matrix *world, M3D_Matrix *view, M3D_Matrix *projection, double guardband, int cullflags, GCORE_CullCounts *counts, GCORE_TriangleRasterizer *rasterizer, GCORE_Framebuffer *framebuffer);
+
 #endif
@@ -0,0 +1,488 @@
+/*
+Template for the geometry stages of the graphics core, included by gcore.c once for each precision of triangle buffers
+Before including, REAL names the element type of the buffers and REAL_NAME(name) names a function of that precision
+Whatever the precision of the buffers, clipping, snapping and triangle setup compute in double
+
+Copyright (C) 2015-2016 Kyle Gagner
+All rights reserved
+*/
+
+// clips one triangle as a polygon against the planes marked, one plane at a time, each plane adding at most one vertex
+// writes the polygon as a fan of up to capacity triangles and returns the number written
+int REAL_NAME(ClipPolygon)(REAL *ctriangle, int attributes, int statics, int planes, double guardband, REAL *wtriangle, int capacity)
+{
+	// offset to statics in triangle
+	int statoff = 12+3*attributes;
+	// number of elements in a triangle
+	int pitch = statoff+statics;
+	// vertices carry their conventional coordinates followed by their barycentric coordinates in the original triangle
+	double polygons[2][9][7];
+	int size = 3;
+	int current = 0;
+	for(int i = 0; i < 3; i++)
+	{
+		for(int k = 0; k < 4; k++) polygons[0][i][k] = ctriangle[4*i+k];
+		for(int k = 0; k < 3; k++) polygons[0][i][4+k] = k==i ? 1.0 : 0.0;
+	}
+	for(int j = 0; j < 6 && size >= 3; j++)
+	{
+		if(!((planes >> j) & 1)) continue;
+		// x, y, or z cutting plane
+		int comp = j/2;
+		// w scaled out to the guard band for the x and y planes
+		double scale = comp < 2 ? guardband : 1.0;
+		// w+comp=0 planes for even j, w-comp=0 planes for odd j
+		double sign = j%2 ? -1.0 : 1.0;
+		int next = 0;
+		for(int i = 0; i < size; i++)
+		{
+			double *cvertex = polygons[current][i];
+			double *nvertex = polygons[current][(i+1)%size];
+			// distances to the inside of the plane, negative when outside as marked in the regions
+			double cdist = scale*cvertex[3]+sign*cvertex[comp];
+			double ndist = scale*nvertex[3]+sign*nvertex[comp];
+			if(cdist >= 0) memcpy(polygons[!current][next++], cvertex, 7*sizeof(double));
+			// the edge crosses the plane, the crossing point is linear in clip space
+			if((cdist > 0 && ndist < 0) || (cdist < 0 && ndist > 0))
+			{
+				double t = cdist/(cdist-ndist);
+				for(int k = 0; k < 7; k++) polygons[!current][next][k] = cvertex[k]+(nvertex[k]-cvertex[k])*t;
+				next++;
+			}
+		}
+		size = next;
+		current = !current;
+	}
+	// the polygon is convex, so it is written out as a fan around its first vertex
+	int written = 0;
+	for(int i = 1; i+1 < size && written < capacity; i++)
+	{
+		double *fan[3] = {polygons[current][0], polygons[current][i], polygons[current][i+1]};
+		for(int k = 0; k < 12; k++) wtriangle[k] = fan[k/4][k%4];
+		for(int k = 0; k < 3; k++)
+		{
+			for(int j = 0; j < attributes; j++)
+			{
+				wtriangle[12+attributes*k+j] =
+					ctriangle[12+j] * fan[k][4] +
+					ctriangle[12+j+attributes] * fan[k][5] +
+					ctriangle[12+j+2*attributes] * fan[k][6];
+			}
+		}
+		memcpy(wtriangle+statoff, ctriangle+statoff, statics*sizeof(REAL));
+		wtriangle += pitch;
+		written++;
+	}
+	return written;
+}
+
+// clips triangles from first up to count into the output buffer until it is full
+// takes the arguments of GCORE_ClipTrianglesGuardBand, the first triangle to clip, a pointer to receive the number of the first triangle not consumed,
+// and optionally room for CLIP_FAN triangles and a pointer to receive how many of them overflowed the output buffer
+// without the overflow room, triangles of a fan not fitting the output buffer are lost
+// returns the number of triangles placed in the output buffer
+int REAL_NAME(ClipStream)(REAL *buffin, int attributes, int statics, int first, int count, REAL *buffout, int capacity, double guardband, int *consumed, REAL *overflow, int *overflowcount)
+{
+	// pointer to location in output buffer for next triangle
+	REAL *wtriangle = buffout;
+	// number of triangles written out
+	int written = 0;
+	// number of elements in a triangle
+	int pitch = 12+3*attributes+statics;
+	// vertex coordinates of a batch as a structure of arrays, and their regions
+	double x[3*CLIP_BATCH], y[3*CLIP_BATCH], z[3*CLIP_BATCH], w[3*CLIP_BATCH];
+	int regions[3*CLIP_BATCH];
+	if(overflowcount) *overflowcount = 0;
+	for(int batch = first; batch < count; batch += CLIP_BATCH)
+	{
+		int size = count-batch < CLIP_BATCH ? count-batch : CLIP_BATCH;
+		REAL *triangles = buffin+(size_t)pitch*batch;
+		for(int n = 0; n < size; n++)
+		{
+			for(int i = 0; i < 3; i++)
+			{
+				REAL *cvertex = triangles+(size_t)pitch*n+4*i;
+				x[3*n+i] = cvertex[0];
+				y[3*n+i] = cvertex[1];
+				z[3*n+i] = cvertex[2];
+				w[3*n+i] = cvertex[3];
+			}
+		}
+		ClipClassify(x, y, z, w, 3*size, guardband, regions);
+		// triangles needing clipping, in order, with the trivially accepted triangles before each making up a run
+		int clip[CLIP_BATCH+1];
+		int runs[CLIP_BATCH+1];
+		int clipcount = 0;
+		int run = 0;
+		for(int n = 0; n < size; n++)
+		{
+			int all = regions[3*n] | regions[3*n+1] | regions[3*n+2];
+			int common = regions[3*n] & regions[3*n+1] & regions[3*n+2];
+			// trivial accept, entire triangle is within the guard band and not entirely outside the cube
+			if(!(all & 0x3F) && !(common & 0x3F0))
+			{
+				run++;
+				continue;
+			}
+			// trivial reject, entire triangle is on the wrong side of at least one of the clipping planes of the cube, is marked negative
+			runs[clipcount] = run;
+			clip[clipcount++] = common & 0x3F0 ? -1-n : n;
+			run = 0;
+		}
+		runs[clipcount] = run;
+		clip[clipcount] = size;
+		// accepted runs go out in one copy each, only the triangles needing it go through the polygon clipper
+		int start = 0;
+		for(int i = 0; i <= clipcount; i++)
+		{
+			int copy = runs[i] < capacity-written ? runs[i] : capacity-written;
+			memcpy(wtriangle, triangles+(size_t)pitch*start, (size_t)pitch*copy*sizeof(REAL));
+			wtriangle += (size_t)pitch*copy;
+			written += copy;
+			if(written == capacity)
+			{
+				*consumed = batch+start+copy;
+				return capacity;
+			}
+			if(i == clipcount) break;
+			int n = clip[i] < 0 ? -1-clip[i] : clip[i];
+			start = n+1;
+			if(clip[i] < 0) continue;
+			int all = regions[3*n] | regions[3*n+1] | regions[3*n+2];
+			int fan;
+			// near the end of the output buffer the fan goes to the overflow room, and what fits is moved on
+			if(overflow && capacity-written < CLIP_FAN)
+			{
+				fan = REAL_NAME(ClipPolygon)(triangles+(size_t)pitch*n, attributes, statics, all & 0x3F, guardband, overflow, CLIP_FAN);
+				int fits = fan < capacity-written ? fan : capacity-written;
+				memcpy(wtriangle, overflow, (size_t)pitch*fits*sizeof(REAL));
+				memmove(overflow, overflow+(size_t)pitch*fits, (size_t)pitch*(fan-fits)*sizeof(REAL));
+				*overflowcount = fan-fits;
+				fan = fits;
+			}
+			else fan = REAL_NAME(ClipPolygon)(triangles+(size_t)pitch*n, attributes, statics, all & 0x3F, guardband, wtriangle, capacity-written);
+			wtriangle += (size_t)pitch*fan;
+			written += fan;
+			if(written == capacity)
+			{
+				*consumed = batch+n+1;
+				return capacity;
+			}
+		}
+	}
+	*consumed = count;
+	return written;
+}
+
+int REAL_NAME(GCORE_ClipTrianglesGuardBand)(REAL *buffin, int attributes, int statics, int count, REAL *buffout, int capacity, double guardband)
+{
+	int consumed;
+	return REAL_NAME(ClipStream)(buffin, attributes, statics, 0, count, buffout, capacity, guardband, &consumed, NULL, NULL);
+}
+
+int REAL_NAME(GCORE_ClipTriangles)(REAL *buffin, int attributes, int statics, int count, REAL *buffout, int capacity)
+{
+	return REAL_NAME(GCORE_ClipTrianglesGuardBand)(buffin, attributes, statics, count, buffout, capacity, 1.0);
+}
+
+// transforms the coordinates and normals of triangles in place
+// takes the arguments of GCORE_TransformTriangles but with the coordinate and normal transforms made
+void REAL_NAME(TransformStreams)(REAL *buff, int attributes, int statics, int count, int anormal, int snormal, M3D_Matrix *coordtrans, M3D_Matrix *normtrans)
+{
+	// number of elements per triangle
+	int pitch = 12+3*attributes+statics;
+	// each vertex and normal of every triangle is one stream through the transforms, a pitch apart
+	for(int i = 0; i < 3; i++)
+	{
+		REAL_NAME(M3D_TransformPoints)(coordtrans, buff+4*i, pitch, count, buff+4*i, pitch);
+		if(anormal != -1) REAL_NAME(M3D_TransformDirections)(normtrans, buff+12+anormal+attributes*i, pitch, count, buff+12+anormal+attributes*i, pitch);
+	}
+	if(snormal != -1) REAL_NAME(M3D_TransformDirections)(normtrans, buff+12+3*attributes+snormal, pitch, count, buff+12+3*attributes+snormal, pitch);
+}
+
+int REAL_NAME(GCORE_TransformTriangles)(REAL *buff, int attributes, int statics, int count, int anormal, int snormal, M3D_Matrix *world, M3D_Matrix *view, M3D_Matrix *projection)
+{
+	// normal transform
+	M3D_Matrix normtrans;
+	// coordinate transform
+	M3D_Matrix coordtrans;
+	M3D_NormalMatrix(world, &normtrans);
+	M3DI_Multiply3(projection, view, world, &coordtrans);
+	REAL_NAME(TransformStreams)(buff, attributes, statics, count, anormal, snormal, &coordtrans, &normtrans);
+	return count;
+}
+
+// snaps the vertices of a triangle to sub-pixel fixed point
+// returns twice the signed area in fixed point, positive if counterclockwise in normalized device coordinates
+long long REAL_NAME(TriangleSnap)(REAL *ctriangle, int width, int height, long long *fx, long long *fy)
+{
+	for(int i = 0; i < 3; i++)
+	{
+		// the projection is done in double whatever the precision of the triangle
+		double w = ctriangle[4*i+3];
+		fx[i] = llround(0.5*(width*(double)ctriangle[4*i]/w+width)*(1<<GCORE_SUBPIXEL));
+		fy[i] = llround(0.5*(height*(double)ctriangle[4*i+1]/w+height)*(1<<GCORE_SUBPIXEL));
+	}
+	return (fx[1]-fx[0])*(fy[2]-fy[0])-(fy[1]-fy[0])*(fx[2]-fx[0]);
+}
+
+int REAL_NAME(GCORE_CullTriangles)(REAL *buff, int attributes, int statics, int count, int width, int height, int flags, GCORE_CullCounts *counts)
+{
+	// pointer to current triangle
+	REAL *ctriangle = buff;
+	// pointer to location for next triangle kept
+	REAL *wtriangle = buff;
+	// number of elements per triangle
+	int pitch = 12+3*attributes+statics;
+	int kept = 0;
+	GCORE_CullCounts culled = {0, 0, 0};
+	for(int n = 0; n < count; n++, ctriangle += pitch)
+	{
+		long long fx[3], fy[3];
+		long long area = REAL_NAME(TriangleSnap)(ctriangle, width, height, fx, fy);
+		if(area == 0)
+		{
+			culled.degenerate++;
+			continue;
+		}
+		// front faces wind counterclockwise unless flagged otherwise
+		int front = (area > 0) != !!(flags & GCORE_CULL_CLOCKWISE);
+		if(flags & (front ? GCORE_CULL_FRONT : GCORE_CULL_BACK))
+		{
+			culled.facing++;
+			continue;
+		}
+		if(flags & GCORE_CULL_EMPTY)
+		{
+			if(area < 0)
+			{
+				long long tmp;
+				tmp = fx[1]; fx[1] = fx[2]; fx[2] = tmp;
+				tmp = fy[1]; fy[1] = fy[2]; fy[2] = tmp;
+			}
+			long long fxmin = fx[0] < fx[1] ? (fx[0] < fx[2] ? fx[0] : fx[2]) : (fx[1] < fx[2] ? fx[1] : fx[2]);
+			long long fxmax = fx[0] > fx[1] ? (fx[0] > fx[2] ? fx[0] : fx[2]) : (fx[1] > fx[2] ? fx[1] : fx[2]);
+			long long fymin = fy[0] < fy[1] ? (fy[0] < fy[2] ? fy[0] : fy[2]) : (fy[1] < fy[2] ? fy[1] : fy[2]);
+			long long fymax = fy[0] > fy[1] ? (fy[0] > fy[2] ? fy[0] : fy[2]) : (fy[1] > fy[2] ? fy[1] : fy[2]);
+			long long xfirst, xlast, yfirst, ylast;
+			PixelCenters(fxmin, fxmax, width, &xfirst, &xlast);
+			PixelCenters(fymin, fymax, height, &yfirst, &ylast);
+			// a bounding box holding no pixel center is empty, one holding only a few has them tested against the edges
+			int empty = xfirst > xlast || yfirst > ylast;
+			if(!empty && xlast-xfirst < 2 && ylast-yfirst < 2)
+			{
+				empty = 1;
+				for(long long y = yfirst; empty && y <= ylast; y++)
+				{
+					for(long long x = xfirst; empty && x <= xlast; x++)
+					{
+						long long px = (x << GCORE_SUBPIXEL)+(1 << (GCORE_SUBPIXEL-1));
+						long long py = (y << GCORE_SUBPIXEL)+(1 << (GCORE_SUBPIXEL-1));
+						int inside = 1;
+						for(int i = 0; i < 3; i++)
+						{
+							long long dx = fx[(i+2)%3]-fx[(i+1)%3];
+							long long dy = fy[(i+2)%3]-fy[(i+1)%3];
+							// the same top-left fill rule as the rasterizers
+							if(dx*(py-fy[(i+1)%3])-dy*(px-fx[(i+1)%3]) < (dy < 0 || (dy == 0 && dx > 0) ? 0 : 1)) inside = 0;
+						}
+						if(inside) empty = 0;
+					}
+				}
+			}
+			if(empty)
+			{
+				culled.empty++;
+				continue;
+			}
+		}
+		// triangles kept slide down over the culled ones, keeping their order
+		if(wtriangle != ctriangle) memmove(wtriangle, ctriangle, pitch*sizeof(REAL));
+		wtriangle += pitch;
+		kept++;
+	}
+	if(counts) *counts = culled;
+	return kept;
+}
+
+int REAL_NAME(GCORE_TriangleSetupCompute)(GCORE_TriangleSetup *setup, REAL *ctriangle, int attributes, int statics, double *planes, int width, int height)
+{
+	// vertex order, swapped below so that every triangle is walked with the same orientation
+	int order[3] = {0, 1, 2};
+	long long fx[3], fy[3];
+	long long area = REAL_NAME(TriangleSnap)(ctriangle, width, height, fx, fy);
+	if(area == 0) return 0;
+	if(area < 0)
+	{
+		long long tmp;
+		tmp = fx[1]; fx[1] = fx[2]; fx[2] = tmp;
+		tmp = fy[1]; fy[1] = fy[2]; fy[2] = tmp;
+		order[1] = 2;
+		order[2] = 1;
+		area = -area;
+	}
+	// bounding box of the pixel centers, intersected with the raster
+	long long fxmin = fx[0] < fx[1] ? (fx[0] < fx[2] ? fx[0] : fx[2]) : (fx[1] < fx[2] ? fx[1] : fx[2]);
+	long long fxmax = fx[0] > fx[1] ? (fx[0] > fx[2] ? fx[0] : fx[2]) : (fx[1] > fx[2] ? fx[1] : fx[2]);
+	long long fymin = fy[0] < fy[1] ? (fy[0] < fy[2] ? fy[0] : fy[2]) : (fy[1] < fy[2] ? fy[1] : fy[2]);
+	long long fymax = fy[0] > fy[1] ? (fy[0] > fy[2] ? fy[0] : fy[2]) : (fy[1] > fy[2] ? fy[1] : fy[2]);
+	setup->left = (fxmin >> GCORE_SUBPIXEL) > 0 ? (fxmin >> GCORE_SUBPIXEL) : 0;
+	setup->right = (fxmax >> GCORE_SUBPIXEL)+1 < width ? (fxmax >> GCORE_SUBPIXEL)+1 : width;
+	setup->top = (fymin >> GCORE_SUBPIXEL) > 0 ? (fymin >> GCORE_SUBPIXEL) : 0;
+	setup->bottom = (fymax >> GCORE_SUBPIXEL)+1 < height ? (fymax >> GCORE_SUBPIXEL)+1 : height;
+	if(setup->left >= setup->right || setup->top >= setup->bottom) return 0;
+	// center of the corner pixel of the bounding box
+	long long px = ((long long)setup->left << GCORE_SUBPIXEL)+(1 << (GCORE_SUBPIXEL-1));
+	long long py = ((long long)setup->top << GCORE_SUBPIXEL)+(1 << (GCORE_SUBPIXEL-1));
+	// edge i is opposite vertex i, its edge function is the barycentric weight of vertex i scaled by area
+	for(int i = 0; i < 3; i++)
+	{
+		int a = (i+1)%3;
+		int b = (i+2)%3;
+		long long dx = fx[b]-fx[a];
+		long long dy = fy[b]-fy[a];
+		setup->stepx[i] = -dy*(1 << GCORE_SUBPIXEL);
+		setup->stepy[i] = dx*(1 << GCORE_SUBPIXEL);
+		setup->edge[i] = dx*(py-fy[a])-dy*(px-fx[a]);
+		// top-left fill rule, pixel centers exactly on an edge belong to the triangle only if it is a left or top edge
+		setup->bias[i] = dy < 0 || (dy == 0 && dx > 0) ? 0 : 1;
+	}
+	// per vertex values which interpolate linearly in screen space, in walking order
+	double invarea = 1.0/area;
+	double winv[3], zw[3], weight1[3], weight2[3], values[3];
+	for(int i = 0; i < 3; i++)
+	{
+		REAL *cvertex = ctriangle+4*order[i];
+		winv[i] = 1.0/cvertex[3];
+		zw[i] = cvertex[2]*winv[i];
+		weight1[i] = order[i] == 1 ? winv[i] : 0;
+		weight2[i] = order[i] == 2 ? winv[i] : 0;
+	}
+	// depth range of the triangle, z/w is linear in screen space so its extremes are at the vertices
+	setup->zmin = zw[0] < zw[1] ? (zw[0] < zw[2] ? zw[0] : zw[2]) : (zw[1] < zw[2] ? zw[1] : zw[2]);
+	setup->zmax = zw[0] > zw[1] ? (zw[0] > zw[2] ? zw[0] : zw[2]) : (zw[1] > zw[2] ? zw[1] : zw[2]);
+	PlaneEquation(setup, winv, invarea, setup->winv);
+	PlaneEquation(setup, zw, invarea, setup->zw);
+	PlaneEquation(setup, weight1, invarea, setup->weights[0]);
+	PlaneEquation(setup, weight2, invarea, setup->weights[1]);
+	for(int j = 0; j < attributes; j++)
+	{
+		for(int i = 0; i < 3; i++) values[i] = ctriangle[12+attributes*order[i]+j]*winv[i];
+		PlaneEquation(setup, values, invarea, planes+3*j);
+	}
+	setup->attributes = planes;
+	// statics follow the planes, so the kernels find them the same way whatever the precision of the triangle
+	setup->statics = planes+3*attributes;
+	for(int j = 0; j < statics; j++) setup->statics[j] = ctriangle[12+3*attributes+j];
+	return 1;
+}
+
+void REAL_NAME(RasterTriangles)(TriangleKernel kernel, REAL *buff, int attributes, int statics, int count, GCORE_Framebuffer *framebuffer)
+{
+	// pointer to current triangle
+	REAL *ctriangle = buff;
+	// number of elements per triangle
+	int pitch = 12+3*attributes+statics;
+	GCORE_TriangleSetup setup;
+	double *planes = malloc((3*attributes+statics)*sizeof(double));
+	for(int n = 0; n < count; n++)
+	{
+		if(REAL_NAME(GCORE_TriangleSetupCompute)(&setup, ctriangle, attributes, statics, planes, framebuffer->width, framebuffer->height))
+		{
+			kernel(&setup, n, attributes, statics, framebuffer, 0, 0, framebuffer->width, framebuffer->height);
+		}
+		ctriangle += pitch;
+	}
+	free(planes);
+}
+
+void REAL_NAME(GCORE_TriangleRaster)(REAL *buff, int attributes, int statics, int count, double *zbuff, double *abuff, int width, int height)
+{
+	GCORE_Framebuffer framebuffer;
+	FramebufferWrap(&framebuffer, zbuff, abuff, NULL, attributes+statics, width, height, NULL);
+	REAL_NAME(RasterTriangles)(ScanlineTriangle, buff, attributes, statics, count, &framebuffer);
+}
+
+void REAL_NAME(GCORE_TriangleRasterHalfspace)(REAL *buff, int attributes, int statics, int count, double *zbuff, double *abuff, int width, int height)
+{
+	GCORE_Framebuffer framebuffer;
+	FramebufferWrap(&framebuffer, zbuff, abuff, NULL, attributes+statics, width, height, NULL);
+	REAL_NAME(RasterTriangles)(HalfspaceTriangle, buff, attributes, statics, count, &framebuffer);
+}
+
+void REAL_NAME(GCORE_TriangleRasterFramebuffer)(REAL *buff, int attributes, int statics, int count, GCORE_Framebuffer *framebuffer)
+{
+	REAL_NAME(RasterTriangles)(ScanlineTriangle, buff, attributes, statics, count, framebuffer);
+}
+
+void REAL_NAME(GCORE_TriangleRasterizerRasterFramebuffer)(GCORE_TriangleRasterizer *rasterizer, REAL *buff, int attributes, int statics, int count, GCORE_Framebuffer *framebuffer)
+{
+	int width = framebuffer->width;
+	int height = framebuffer->height;
+	// pointer to current triangle
+	REAL *ctriangle = buff;
+	// number of elements per triangle
+	int pitch = 12+3*attributes+statics;
+	int tilesize = rasterizer->tilesize;
+	int columns = (width+tilesize-1)/tilesize;
+	int rows = (height+tilesize-1)/tilesize;
+	int tilecount = columns*rows;
+	// grow the bins if the raster has more tiles than ever before, bins are kept between calls
+	if(tilecount > rasterizer->tilecapacity)
+	{
+		rasterizer->binsizes = realloc(rasterizer->binsizes, tilecount*sizeof(int));
+		rasterizer->bincapacities = realloc(rasterizer->bincapacities, tilecount*sizeof(int));
+		rasterizer->bins = realloc(rasterizer->bins, tilecount*sizeof(int*));
+		for(int i = rasterizer->tilecapacity; i < tilecount; i++)
+		{
+			rasterizer->bincapacities[i] = 0;
+			rasterizer->bins[i] = NULL;
+		}
+		rasterizer->tilecapacity = tilecount;
+	}
+	rasterizer->tilecount = tilecount;
+	// likewise the triangle setups, each triangle is set up once however many tiles it touches
+	if(count > rasterizer->setupcapacity)
+	{
+		rasterizer->setups = realloc(rasterizer->setups, count*sizeof(GCORE_TriangleSetup));
+		rasterizer->setupcapacity = count;
+	}
+	// and the attribute planes and statics of the setups
+	size_t planesize = 3*attributes+statics;
+	if(planesize*count > rasterizer->planecapacity)
+	{
+		rasterizer->planes = realloc(rasterizer->planes, planesize*count*sizeof(double));
+		rasterizer->planecapacity = planesize*count;
+	}
+	for(int i = 0; i < tilecount; i++) rasterizer->binsizes[i] = 0;
+	// binning front end, each triangle goes into every tile its bounding box overlaps
+	for(int n = 0; n < count; n++)
+	{
+		GCORE_TriangleSetup *setup = &rasterizer->setups[n];
+		int visible = REAL_NAME(GCORE_TriangleSetupCompute)(setup, ctriangle, attributes, statics, rasterizer->planes+planesize*n, width, height);
+		ctriangle += pitch;
+		if(!visible) continue;
+		int tleft = setup->left/tilesize;
+		int ttop = setup->top/tilesize;
+		int tright = (setup->right-1)/tilesize;
+		int tbottom = (setup->bottom-1)/tilesize;
+		for(int ty = ttop; ty <= tbottom; ty++)
+		{
+			for(int tx = tleft; tx <= tright; tx++)
+			{
+				int tile = tx+columns*ty;
+				if(rasterizer->binsizes[tile] == rasterizer->bincapacities[tile])
+				{
+					rasterizer->bincapacities[tile] = rasterizer->bincapacities[tile] ? 2*rasterizer->bincapacities[tile] : 64;
+					rasterizer->bins[tile] = realloc(rasterizer->bins[tile], rasterizer->bincapacities[tile]*sizeof(int));
+				}
+				rasterizer->bins[tile][rasterizer->binsizes[tile]++] = n;
+			}
+		}
+	}
+	// back end, tiles are disjoint so no locking is needed on the z and attribute buffers
+	TileJob job = {.rasterizer = rasterizer, .kernel = rasterizer->flags & GCORE_RASTER_HALFSPACE ? HalfspaceTriangle : ScanlineTriangle, .attributes = attributes, .statics = statics, .framebuffer = framebuffer, .columns = columns, .next = 0};
+	mtx_init(&job.lock, mtx_plain);
+	WORKERS_Run(TileWorker, &job, rasterizer->threads);
+	mtx_destroy(&job.lock);
+}
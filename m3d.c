@@ -8,7 +8,14 @@ All rights reserved
 */
 
 #include "m3d.h"
+#include "workers.h"
 #include <math.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#if !defined(M3D_SCALAR) && defined(__AVX__)
+#include <immintrin.h>
+#endif
 
 void M3D_Transform(M3D_Matrix *left, M3D_Vector* right, M3D_Vector* result)
 {
@@ -18,6 +25,82 @@ void M3D_Transform(M3D_Matrix *left, M3D_Vector* right, M3D_Vector* result)
 	(*result)[3] = (*left)[3][0] * (*right)[0] + (*left)[3][1] * (*right)[1] + (*left)[3][2] * (*right)[2] + (*left)[3][3] * (*right)[3];
 }
 
+// the stream transforms in double precision, vectorized with AVX unless M3D_SCALAR is defined
+#define REAL double
+#define REAL_NAME(name) name
+#if !defined(M3D_SCALAR) && defined(__AVX__)
+#define M3D_VECTOR
+#define VEC4 __m256d
+#define VEC4_SET(x, y, z, w) _mm256_set_pd(w, z, y, x)
+#define VEC4_BROADCAST(p) _mm256_broadcast_sd(p)
+#define VEC4_ADD(a, b) _mm256_add_pd(a, b)
+#define VEC4_MUL(a, b) _mm256_mul_pd(a, b)
+#define VEC4_STORE(p, a) _mm256_storeu_pd(p, a)
+#define VEC4_STORE3(p, a) _mm256_maskstore_pd(p, _mm256_set_epi64x(0, -1, -1, -1), a)
+#define VECN __m256d
+#define VECN_LANES 4
+#define VECN_SET(x) _mm256_set1_pd(x)
+#define VECN_LOAD(p) _mm256_loadu_pd(p)
+#define VECN_ADD(a, b) _mm256_add_pd(a, b)
+#define VECN_MUL(a, b) _mm256_mul_pd(a, b)
+#define VECN_STORE(p, a) _mm256_storeu_pd(p, a)
+#endif
+#include "m3dreal.h"
+#undef REAL
+#undef REAL_NAME
+#undef VEC4
+#undef VEC4_SET
+#undef VEC4_BROADCAST
+#undef VEC4_ADD
+#undef VEC4_MUL
+#undef VEC4_STORE
+#undef VEC4_STORE3
+#undef VECN
+#undef VECN_LANES
+#undef VECN_SET
+#undef VECN_LOAD
+#undef VECN_ADD
+#undef VECN_MUL
+#undef VECN_STORE
+
+// and in single precision, a point filling half the vector width and a stream of them the whole
+#define REAL float
+#define REAL_NAME(name) name##F
+#ifdef M3D_VECTOR
+#define VEC4 __m128
+#define VEC4_SET(x, y, z, w) _mm_set_ps(w, z, y, x)
+#define VEC4_BROADCAST(p) _mm_broadcast_ss(p)
+#define VEC4_ADD(a, b) _mm_add_ps(a, b)
+#define VEC4_MUL(a, b) _mm_mul_ps(a, b)
+#define VEC4_STORE(p, a) _mm_storeu_ps(p, a)
+#define VEC4_STORE3(p, a) _mm_maskstore_ps(p, _mm_set_epi32(0, -1, -1, -1), a)
+#define VECN __m256
+#define VECN_LANES 8
+#define VECN_SET(x) _mm256_set1_ps(x)
+#define VECN_LOAD(p) _mm256_loadu_ps(p)
+#define VECN_ADD(a, b) _mm256_add_ps(a, b)
+#define VECN_MUL(a, b) _mm256_mul_ps(a, b)
+#define VECN_STORE(p, a) _mm256_storeu_ps(p, a)
+#endif
+#include "m3dreal.h"
+#undef REAL
+#undef REAL_NAME
+#undef M3D_VECTOR
+#undef VEC4
+#undef VEC4_SET
+#undef VEC4_BROADCAST
+#undef VEC4_ADD
+#undef VEC4_MUL
+#undef VEC4_STORE
+#undef VEC4_STORE3
+#undef VECN
+#undef VECN_LANES
+#undef VECN_SET
+#undef VECN_LOAD
+#undef VECN_ADD
+#undef VECN_MUL
+#undef VECN_STORE
+
 void M3D_Add(M3D_Vector *left, M3D_Vector *right, M3D_Vector *result)
 {
 	(*result)[0] = (*left)[0] + (*right)[0];
@@ -291,13 +374,123 @@ void M3D_Transpose(M3D_Matrix *operand, M3D_Matrix *result)
 	(*result)[3][3] = (*operand)[3][3];
 }
 
+int M3D_Affine(M3D_Matrix *operand)
+{
+	return (*operand)[3][0] == 0 && (*operand)[3][1] == 0 && (*operand)[3][2] == 0 && (*operand)[3][3] == 1;
+}
+
+int M3D_Rigid(M3D_Matrix *operand)
+{
+	if(!M3D_Affine(operand)) return 0;
+	double *x = (*operand)[0];
+	double *y = (*operand)[1];
+	double *z = (*operand)[2];
+	// squared lengths of the rows less one and the dot products between them, all tested without branching between them
+	double xx = x[0] * x[0] + x[1] * x[1] + x[2] * x[2] - 1;
+	double yy = y[0] * y[0] + y[1] * y[1] + y[2] * y[2] - 1;
+	double zz = z[0] * z[0] + z[1] * z[1] + z[2] * z[2] - 1;
+	double xy = x[0] * y[0] + x[1] * y[1] + x[2] * y[2];
+	double xz = x[0] * z[0] + x[1] * z[1] + x[2] * z[2];
+	double yz = y[0] * z[0] + y[1] * z[1] + y[2] * z[2];
+	return (fabs(xx) <= M3D_RIGID_TOLERANCE) & (fabs(yy) <= M3D_RIGID_TOLERANCE) & (fabs(zz) <= M3D_RIGID_TOLERANCE) &
+		(fabs(xy) <= M3D_RIGID_TOLERANCE) & (fabs(xz) <= M3D_RIGID_TOLERANCE) & (fabs(yz) <= M3D_RIGID_TOLERANCE);
+}
+
+// finds the cofactors of the upper left 3x3 of a matrix
+// takes a pointer to the operand matrix and the cofactors, row major
+// returns the determinant of the 3x3
+double Cofactors(M3D_Matrix *operand, double (*cofactors)[3])
+{
+	cofactors[0][0] = (*operand)[1][1] * (*operand)[2][2] - (*operand)[1][2] * (*operand)[2][1];
+	cofactors[0][1] = (*operand)[1][2] * (*operand)[2][0] - (*operand)[1][0] * (*operand)[2][2];
+	cofactors[0][2] = (*operand)[1][0] * (*operand)[2][1] - (*operand)[1][1] * (*operand)[2][0];
+	cofactors[1][0] = (*operand)[0][2] * (*operand)[2][1] - (*operand)[0][1] * (*operand)[2][2];
+	cofactors[1][1] = (*operand)[0][0] * (*operand)[2][2] - (*operand)[0][2] * (*operand)[2][0];
+	cofactors[1][2] = (*operand)[0][1] * (*operand)[2][0] - (*operand)[0][0] * (*operand)[2][1];
+	cofactors[2][0] = (*operand)[0][1] * (*operand)[1][2] - (*operand)[0][2] * (*operand)[1][1];
+	cofactors[2][1] = (*operand)[0][2] * (*operand)[1][0] - (*operand)[0][0] * (*operand)[1][2];
+	cofactors[2][2] = (*operand)[0][0] * (*operand)[1][1] - (*operand)[0][1] * (*operand)[1][0];
+	return (*operand)[0][0] * cofactors[0][0] + (*operand)[0][1] * cofactors[0][1] + (*operand)[0][2] * cofactors[0][2];
+}
+
+void M3D_InverseAffine(M3D_Matrix *operand, M3D_Matrix *result)
+{
+	double cofactors[3][3];
+	double scl = 1.0 / Cofactors(operand, cofactors);
+	for(int i = 0; i < 3; i++)
+	{
+		(*result)[i][0] = scl * cofactors[0][i];
+		(*result)[i][1] = scl * cofactors[1][i];
+		(*result)[i][2] = scl * cofactors[2][i];
+		(*result)[i][3] = -((*result)[i][0] * (*operand)[0][3] + (*result)[i][1] * (*operand)[1][3] + (*result)[i][2] * (*operand)[2][3]);
+	}
+	(*result)[3][0] = 0;
+	(*result)[3][1] = 0;
+	(*result)[3][2] = 0;
+	(*result)[3][3] = 1;
+}
+
+void M3D_InverseRigid(M3D_Matrix *operand, M3D_Matrix *result)
+{
+	for(int i = 0; i < 3; i++)
+	{
+		(*result)[i][0] = (*operand)[0][i];
+		(*result)[i][1] = (*operand)[1][i];
+		(*result)[i][2] = (*operand)[2][i];
+		(*result)[i][3] = -((*operand)[0][i] * (*operand)[0][3] + (*operand)[1][i] * (*operand)[1][3] + (*operand)[2][i] * (*operand)[2][3]);
+	}
+	(*result)[3][0] = 0;
+	(*result)[3][1] = 0;
+	(*result)[3][2] = 0;
+	(*result)[3][3] = 1;
+}
+
 void M3D_InverseTranspose(M3D_Matrix *operand, M3D_Matrix *result)
 {
 	M3D_Matrix temporary;
-	M3D_Inverse(operand, &temporary);
+	if(M3D_Rigid(operand)) M3D_InverseRigid(operand, &temporary);
+	else if(M3D_Affine(operand)) M3D_InverseAffine(operand, &temporary);
+	else M3D_Inverse(operand, &temporary);
 	M3D_Transpose(&temporary, result);
 }
 
+void M3D_NormalMatrix(M3D_Matrix *operand, M3D_Matrix *result)
+{
+	if(!M3D_Affine(operand))
+	{
+		M3D_InverseTranspose(operand, result);
+		return;
+	}
+	if(M3D_Rigid(operand))
+	{
+		for(int i = 0; i < 3; i++)
+		{
+			(*result)[i][0] = (*operand)[i][0];
+			(*result)[i][1] = (*operand)[i][1];
+			(*result)[i][2] = (*operand)[i][2];
+			(*result)[i][3] = 0;
+		}
+		(*result)[3][0] = 0;
+		(*result)[3][1] = 0;
+		(*result)[3][2] = 0;
+		(*result)[3][3] = 1;
+		return;
+	}
+	double cofactors[3][3];
+	double scl = 1.0 / Cofactors(operand, cofactors);
+	for(int i = 0; i < 3; i++)
+	{
+		(*result)[i][0] = scl * cofactors[i][0];
+		(*result)[i][1] = scl * cofactors[i][1];
+		(*result)[i][2] = scl * cofactors[i][2];
+		(*result)[i][3] = 0;
+	}
+	(*result)[3][0] = 0;
+	(*result)[3][1] = 0;
+	(*result)[3][2] = 0;
+	(*result)[3][3] = 1;
+}
+
 void M3D_Multiply(M3D_Matrix *left, M3D_Matrix *right, M3D_Matrix *result)
 {
 	(*result)[0][0] = (*left)[0][0] * (*right)[0][0] + (*left)[0][1] * (*right)[1][0] + (*left)[0][2] * (*right)[2][0] + (*left)[0][3] * (*right)[3][0];
@@ -357,3 +550,493 @@ void M3D_Orthographic(double top, double bottom, double left, double right, doub
 	(*result)[3][2] = 0;
 	(*result)[3][3] = 1;
 }
+
+// least number of nodes per batch of a parallel hierarchy update, subtrees of at most as many being added to a batch until it has as many
+#define HIERARCHY_BATCH 256
+
+void M3D_HierarchyInitialize(M3D_Hierarchy *hierarchy, int capacity)
+{
+	if(capacity < 1) capacity = 1;
+	hierarchy->count = 0;
+	hierarchy->capacity = capacity;
+	hierarchy->parents = malloc(capacity*sizeof(int));
+	hierarchy->locals = malloc(capacity*sizeof(M3D_Matrix));
+	hierarchy->worlds = malloc(capacity*sizeof(M3D_Matrix));
+	hierarchy->normals = malloc(capacity*sizeof(M3D_Matrix));
+	hierarchy->stamps = malloc(capacity*sizeof(unsigned int));
+	hierarchy->generation = 0;
+	hierarchy->order = NULL;
+	hierarchy->trunk = 0;
+	hierarchy->batches = NULL;
+	hierarchy->batchcount = 0;
+	hierarchy->ordered = 0;
+}
+
+int M3D_HierarchyInsert(M3D_Hierarchy *hierarchy, int parent, M3D_Matrix *local)
+{
+	if(hierarchy->count == hierarchy->capacity)
+	{
+		hierarchy->capacity *= 2;
+		hierarchy->parents = realloc(hierarchy->parents, hierarchy->capacity*sizeof(int));
+		hierarchy->locals = realloc(hierarchy->locals, hierarchy->capacity*sizeof(M3D_Matrix));
+		hierarchy->worlds = realloc(hierarchy->worlds, hierarchy->capacity*sizeof(M3D_Matrix));
+		hierarchy->normals = realloc(hierarchy->normals, hierarchy->capacity*sizeof(M3D_Matrix));
+		hierarchy->stamps = realloc(hierarchy->stamps, hierarchy->capacity*sizeof(unsigned int));
+	}
+	int node = hierarchy->count++;
+	hierarchy->parents[node] = parent;
+	memcpy(hierarchy->locals[node], *local, sizeof(M3D_Matrix));
+	hierarchy->stamps[node] = hierarchy->generation+1;
+	return node;
+}
+
+void M3D_HierarchySetLocal(M3D_Hierarchy *hierarchy, int node, M3D_Matrix *local)
+{
+	memcpy(hierarchy->locals[node], *local, sizeof(M3D_Matrix));
+	hierarchy->stamps[node] = hierarchy->generation+1;
+}
+
+// recomputes a node if it or its parent was stamped with the current generation
+// takes a pointer to the hierarchy, the index of the node, and the current generation
+void HierarchyUpdateNode(M3D_Hierarchy *hierarchy, int node, unsigned int generation)
+{
+	int parent = hierarchy->parents[node];
+	if(hierarchy->stamps[node] != generation && (parent < 0 || hierarchy->stamps[parent] != generation)) return;
+	if(parent < 0) memcpy(hierarchy->worlds[node], hierarchy->locals[node], sizeof(M3D_Matrix));
+	else M3D_Multiply(&hierarchy->worlds[parent], &hierarchy->locals[node], &hierarchy->worlds[node]);
+	M3D_NormalMatrix(&hierarchy->worlds[node], &hierarchy->normals[node]);
+	hierarchy->stamps[node] = generation;
+}
+
+void M3D_HierarchyUpdate(M3D_Hierarchy *hierarchy)
+{
+	unsigned int generation = ++hierarchy->generation;
+	for(int i = 0; i < hierarchy->count; i++) HierarchyUpdateNode(hierarchy, i, generation);
+}
+
+// orders the nodes of a hierarchy for parallel updates, keeping parents before children
+// nodes with subtrees larger than HIERARCHY_BATCH form the trunk, put first, and the subtrees hanging from the trunk or from roots outside it,
+// none larger than HIERARCHY_BATCH, are grouped into batches
+// takes a pointer to the hierarchy
+void HierarchyOrder(M3D_Hierarchy *hierarchy)
+{
+	int count = hierarchy->count;
+	// the size of each node's subtree, children following their parents so they are summed in reverse
+	int *sizes = malloc(count*sizeof(int));
+	for(int i = 0; i < count; i++) sizes[i] = 1;
+	for(int i = count-1; i >= 0; i--)
+	{
+		if(hierarchy->parents[i] >= 0) sizes[hierarchy->parents[i]] += sizes[i];
+	}
+	// the head of the subtree holding each node outside the trunk, or -1 for the trunk
+	int *heads = malloc(count*sizeof(int));
+	int trunk = 0;
+	for(int i = 0; i < count; i++)
+	{
+		int parent = hierarchy->parents[i];
+		if(sizes[i] > HIERARCHY_BATCH)
+		{
+			heads[i] = -1;
+			trunk++;
+		}
+		else heads[i] = parent < 0 || heads[parent] < 0 ? i : heads[parent];
+	}
+	// then where each subtree starts in the order, the sizes of heads being replaced by their offsets
+	hierarchy->batches = realloc(hierarchy->batches, (count+1)*sizeof(int));
+	hierarchy->batchcount = 0;
+	int offset = trunk;
+	for(int i = 0; i < count; i++)
+	{
+		if(heads[i] != i) continue;
+		if(!hierarchy->batchcount || offset-hierarchy->batches[hierarchy->batchcount-1] >= HIERARCHY_BATCH)
+		{
+			hierarchy->batches[hierarchy->batchcount++] = offset;
+		}
+		int size = sizes[i];
+		sizes[i] = offset;
+		offset += size;
+	}
+	hierarchy->batches[hierarchy->batchcount] = count;
+	hierarchy->order = realloc(hierarchy->order, count*sizeof(int));
+	trunk = 0;
+	for(int i = 0; i < count; i++)
+	{
+		if(heads[i] < 0) hierarchy->order[trunk++] = i;
+		else hierarchy->order[sizes[heads[i]]++] = i;
+	}
+	free(sizes);
+	free(heads);
+	hierarchy->trunk = trunk;
+	hierarchy->ordered = count;
+}
+
+// work shared between the threads updating the batches of one hierarchy
+typedef struct
+{
+	M3D_Hierarchy *hierarchy;
+	unsigned int generation;
+	mtx_t lock;
+	int next;
+} HierarchyJob;
+
+int HierarchyWorker(void *arg)
+{
+	HierarchyJob *job = arg;
+	M3D_Hierarchy *hierarchy = job->hierarchy;
+	for(;;)
+	{
+		mtx_lock(&job->lock);
+		int batch = job->next++;
+		mtx_unlock(&job->lock);
+		if(batch >= hierarchy->batchcount) break;
+		// a batch holds whole subtrees, parents first, whose heads' parents are in the trunk, so no other thread touches the nodes it reads
+		for(int i = hierarchy->batches[batch]; i < hierarchy->batches[batch+1]; i++) HierarchyUpdateNode(hierarchy, hierarchy->order[i], job->generation);
+	}
+	return 0;
+}
+
+void M3D_HierarchyUpdateParallel(M3D_Hierarchy *hierarchy, int threads)
+{
+	if(threads <= 1 || hierarchy->count <= HIERARCHY_BATCH)
+	{
+		M3D_HierarchyUpdate(hierarchy);
+		return;
+	}
+	if(hierarchy->ordered != hierarchy->count) HierarchyOrder(hierarchy);
+	HierarchyJob job = {.hierarchy = hierarchy, .generation = ++hierarchy->generation, .next = 0};
+	// the trunk is updated before the batches hanging from it
+	for(int i = 0; i < hierarchy->trunk; i++) HierarchyUpdateNode(hierarchy, hierarchy->order[i], job.generation);
+	mtx_init(&job.lock, mtx_plain);
+	WORKERS_Run(HierarchyWorker, &job, threads < hierarchy->batchcount ? threads : hierarchy->batchcount);
+	mtx_destroy(&job.lock);
+}
+
+void M3D_HierarchyClean(M3D_Hierarchy *hierarchy)
+{
+	free(hierarchy->parents);
+	free(hierarchy->locals);
+	free(hierarchy->worlds);
+	free(hierarchy->normals);
+	free(hierarchy->stamps);
+	free(hierarchy->order);
+	free(hierarchy->batches);
+}
+
+// lanes of the batch kernels, the matrices of a batch being processed this many at a time
+#if !defined(M3D_SCALAR) && defined(__AVX__)
+#define BATCH_LANES 4
+#define BATCH_Double __m256d
+#define BATCH_SET(x) _mm256_set1_pd(x)
+#define BATCH_LOAD(p) _mm256_loadu_pd(p)
+#define BATCH_STORE(p, x) _mm256_storeu_pd(p, x)
+#define BATCH_ADD(x, y) _mm256_add_pd(x, y)
+#define BATCH_SUB(x, y) _mm256_sub_pd(x, y)
+#define BATCH_MUL(x, y) _mm256_mul_pd(x, y)
+#define BATCH_DIV(x, y) _mm256_div_pd(x, y)
+#else
+#define BATCH_LANES 1
+#define BATCH_Double double
+#define BATCH_SET(x) (x)
+#define BATCH_LOAD(p) (*(p))
+#define BATCH_STORE(p, x) (*(p) = (x))
+#define BATCH_ADD(x, y) ((x) + (y))
+#define BATCH_SUB(x, y) ((x) - (y))
+#define BATCH_MUL(x, y) ((x) * (y))
+#define BATCH_DIV(x, y) ((x) / (y))
+#endif
+
+#define BATCH_MINOR(a, b, c, d) BATCH_SUB(BATCH_MUL(a, b), BATCH_MUL(c, d))
+#define BATCH_COMBINE(a, x, b, y, c, z) BATCH_ADD(BATCH_SUB(BATCH_MUL(a, x), BATCH_MUL(b, y)), BATCH_MUL(c, z))
+
+// copies the last matrices of a batch, fewer than BATCH_LANES, to or from a block of full width padded with zeros
+// takes a pointer to the first of the matrices, the batch's stride, the number of elements per matrix (16, or 9 for 3x3 batches),
+// the number of matrices, a pointer to the block, and whether to copy into the block (otherwise out of it)
+void BatchTail(double *batch, int stride, int elements, int count, double *block, int into)
+{
+	for(int e = 0; e < elements; e++)
+	{
+		for(int l = 0; l < BATCH_LANES; l++)
+		{
+			if(into) block[BATCH_LANES*e+l] = l < count ? batch[(size_t)stride*e+l] : 0.0;
+			else if(l < count) batch[(size_t)stride*e+l] = block[BATCH_LANES*e+l];
+		}
+	}
+}
+
+// computes the products of BATCH_LANES matrices, all of them before any is stored so the result may overwrite an operand
+// takes pointers to the first matrix of each operand and of the result, and the stride of each
+void BatchMultiplyLanes(double *left, int leftstride, double *right, int rightstride, double *result, int resultstride)
+{
+	BATCH_Double r[16];
+	for(int e = 0; e < 16; e++) r[e] = BATCH_LOAD(right+(size_t)rightstride*e);
+	BATCH_Double products[16];
+	for(int i = 0; i < 4; i++)
+	{
+		BATCH_Double l0 = BATCH_LOAD(left+(size_t)leftstride*(4*i));
+		BATCH_Double l1 = BATCH_LOAD(left+(size_t)leftstride*(4*i+1));
+		BATCH_Double l2 = BATCH_LOAD(left+(size_t)leftstride*(4*i+2));
+		BATCH_Double l3 = BATCH_LOAD(left+(size_t)leftstride*(4*i+3));
+		products[4*i] = BATCH_ADD(BATCH_ADD(BATCH_ADD(BATCH_MUL(l0, r[0]), BATCH_MUL(l1, r[4])), BATCH_MUL(l2, r[8])), BATCH_MUL(l3, r[12]));
+		products[4*i+1] = BATCH_ADD(BATCH_ADD(BATCH_ADD(BATCH_MUL(l0, r[1]), BATCH_MUL(l1, r[5])), BATCH_MUL(l2, r[9])), BATCH_MUL(l3, r[13]));
+		products[4*i+2] = BATCH_ADD(BATCH_ADD(BATCH_ADD(BATCH_MUL(l0, r[2]), BATCH_MUL(l1, r[6])), BATCH_MUL(l2, r[10])), BATCH_MUL(l3, r[14]));
+		products[4*i+3] = BATCH_ADD(BATCH_ADD(BATCH_ADD(BATCH_MUL(l0, r[3]), BATCH_MUL(l1, r[7])), BATCH_MUL(l2, r[11])), BATCH_MUL(l3, r[15]));
+	}
+	for(int e = 0; e < 16; e++) BATCH_STORE(result+(size_t)resultstride*e, products[e]);
+}
+
+// computes the inverses or their transposes, or the determinants, of BATCH_LANES matrices
+// the 2x2 minors of the top two rows and of the bottom two are found once and each cofactor combines three of them,
+// about half the operations of the expansion M3D_Inverse writes out
+// takes a pointer to the first operand and its stride, a pointer to the first result and its stride (or NULL for none),
+// whether to store the inverses transposed, and a pointer to receive the lanes of the determinants
+void BatchInverseLanes(double *operand, int stride, double *result, int resultstride, int transpose, BATCH_Double *determinant)
+{
+	BATCH_Double a[16];
+	for(int e = 0; e < 16; e++) a[e] = BATCH_LOAD(operand+(size_t)stride*e);
+	BATCH_Double s0 = BATCH_MINOR(a[0], a[5], a[4], a[1]);
+	BATCH_Double s1 = BATCH_MINOR(a[0], a[6], a[4], a[2]);
+	BATCH_Double s2 = BATCH_MINOR(a[0], a[7], a[4], a[3]);
+	BATCH_Double s3 = BATCH_MINOR(a[1], a[6], a[5], a[2]);
+	BATCH_Double s4 = BATCH_MINOR(a[1], a[7], a[5], a[3]);
+	BATCH_Double s5 = BATCH_MINOR(a[2], a[7], a[6], a[3]);
+	BATCH_Double c0 = BATCH_MINOR(a[8], a[13], a[12], a[9]);
+	BATCH_Double c1 = BATCH_MINOR(a[8], a[14], a[12], a[10]);
+	BATCH_Double c2 = BATCH_MINOR(a[8], a[15], a[12], a[11]);
+	BATCH_Double c3 = BATCH_MINOR(a[9], a[14], a[13], a[10]);
+	BATCH_Double c4 = BATCH_MINOR(a[9], a[15], a[13], a[11]);
+	BATCH_Double c5 = BATCH_MINOR(a[10], a[15], a[14], a[11]);
+	BATCH_Double det = BATCH_ADD(BATCH_SUB(BATCH_MUL(s0, c5), BATCH_MUL(s1, c4)), BATCH_MUL(s2, c3));
+	det = BATCH_ADD(BATCH_ADD(det, BATCH_MUL(s3, c2)), BATCH_SUB(BATCH_MUL(s5, c0), BATCH_MUL(s4, c1)));
+	*determinant = det;
+	if(!result) return;
+	// cofactors with a leading minus are scaled by the negated reciprocal instead
+	BATCH_Double scl = BATCH_DIV(BATCH_SET(1.0), det);
+	BATCH_Double nscl = BATCH_SUB(BATCH_SET(0.0), scl);
+	BATCH_Double inverse[16];
+	inverse[0] = BATCH_MUL(BATCH_COMBINE(a[5], c5, a[6], c4, a[7], c3), scl);
+	inverse[1] = BATCH_MUL(BATCH_COMBINE(a[1], c5, a[2], c4, a[3], c3), nscl);
+	inverse[2] = BATCH_MUL(BATCH_COMBINE(a[13], s5, a[14], s4, a[15], s3), scl);
+	inverse[3] = BATCH_MUL(BATCH_COMBINE(a[9], s5, a[10], s4, a[11], s3), nscl);
+	inverse[4] = BATCH_MUL(BATCH_COMBINE(a[4], c5, a[6], c2, a[7], c1), nscl);
+	inverse[5] = BATCH_MUL(BATCH_COMBINE(a[0], c5, a[2], c2, a[3], c1), scl);
+	inverse[6] = BATCH_MUL(BATCH_COMBINE(a[12], s5, a[14], s2, a[15], s1), nscl);
+	inverse[7] = BATCH_MUL(BATCH_COMBINE(a[8], s5, a[10], s2, a[11], s1), scl);
+	inverse[8] = BATCH_MUL(BATCH_COMBINE(a[4], c4, a[5], c2, a[7], c0), scl);
+	inverse[9] = BATCH_MUL(BATCH_COMBINE(a[0], c4, a[1], c2, a[3], c0), nscl);
+	inverse[10] = BATCH_MUL(BATCH_COMBINE(a[12], s4, a[13], s2, a[15], s0), scl);
+	inverse[11] = BATCH_MUL(BATCH_COMBINE(a[8], s4, a[9], s2, a[11], s0), nscl);
+	inverse[12] = BATCH_MUL(BATCH_COMBINE(a[4], c3, a[5], c1, a[6], c0), nscl);
+	inverse[13] = BATCH_MUL(BATCH_COMBINE(a[0], c3, a[1], c1, a[2], c0), scl);
+	inverse[14] = BATCH_MUL(BATCH_COMBINE(a[12], s3, a[13], s1, a[14], s0), nscl);
+	inverse[15] = BATCH_MUL(BATCH_COMBINE(a[8], s3, a[9], s1, a[10], s0), scl);
+	for(int e = 0; e < 16; e++)
+	{
+		int source = transpose ? 4*(e%4)+e/4 : e;
+		BATCH_STORE(result+(size_t)resultstride*e, inverse[source]);
+	}
+}
+
+void M3D_BatchPack(M3D_Matrix *matrices, int count, double *batch, int stride)
+{
+	for(int k = 0; k < count; k++)
+	{
+		for(int e = 0; e < 16; e++) batch[(size_t)stride*e+k] = matrices[k][e/4][e%4];
+	}
+}
+
+void M3D_BatchUnpack(double *batch, int stride, int count, M3D_Matrix *matrices)
+{
+	for(int k = 0; k < count; k++)
+	{
+		for(int e = 0; e < 16; e++) matrices[k][e/4][e%4] = batch[(size_t)stride*e+k];
+	}
+}
+
+void M3D_BatchMultiply(int count, double *left, double *right, double *result, int stride)
+{
+	int k = 0;
+	for(; k+BATCH_LANES <= count; k += BATCH_LANES) BatchMultiplyLanes(left+k, stride, right+k, stride, result+k, stride);
+	if(k < count)
+	{
+		double blocks[3][16*BATCH_LANES];
+		BatchTail(left+k, stride, 16, count-k, blocks[0], 1);
+		BatchTail(right+k, stride, 16, count-k, blocks[1], 1);
+		BatchMultiplyLanes(blocks[0], BATCH_LANES, blocks[1], BATCH_LANES, blocks[2], BATCH_LANES);
+		BatchTail(result+k, stride, 16, count-k, blocks[2], 0);
+	}
+}
+
+// inverts a batch or finds its determinants
+// takes the number of matrices, the operand batch, the result batch or NULL, their stride, whether to transpose, and an array for determinants or NULL
+void BatchInverse(int count, double *operand, double *result, int stride, int transpose, double *determinants)
+{
+	for(int k = 0; k < count; k += BATCH_LANES)
+	{
+		double blocks[2][16*BATCH_LANES];
+		double *source = operand+k;
+		double *destination = result ? result+k : NULL;
+		int sourcestride = stride;
+		int destinationstride = stride;
+		int lanes = count-k < BATCH_LANES ? count-k : BATCH_LANES;
+		// the last few matrices go through blocks of full width
+		if(lanes < BATCH_LANES)
+		{
+			BatchTail(source, stride, 16, lanes, blocks[0], 1);
+			source = blocks[0];
+			sourcestride = BATCH_LANES;
+			if(result) destination = blocks[1];
+			destinationstride = BATCH_LANES;
+		}
+		BATCH_Double determinant;
+		BatchInverseLanes(source, sourcestride, destination, destinationstride, transpose, &determinant);
+		if(result && lanes < BATCH_LANES) BatchTail(result+k, stride, 16, lanes, blocks[1], 0);
+		if(determinants)
+		{
+			double values[BATCH_LANES];
+			BATCH_STORE(values, determinant);
+			for(int l = 0; l < lanes; l++) determinants[k+l] = values[l];
+		}
+	}
+}
+
+void M3D_BatchInverse(int count, double *operand, double *result, int stride)
+{
+	BatchInverse(count, operand, result, stride, 0, NULL);
+}
+
+void M3D_BatchInverseTranspose(int count, double *operand, double *result, int stride)
+{
+	BatchInverse(count, operand, result, stride, 1, NULL);
+}
+
+void M3D_BatchDeterminant(int count, double *operand, int stride, double *determinants)
+{
+	BatchInverse(count, operand, NULL, stride, 0, determinants);
+}
+
+// computes the products of BATCH_LANES 3x3 matrices, all of them before any is stored so the result may overwrite an operand
+// takes pointers to the first matrix of each operand and of the result, and the stride of each
+void Batch3MultiplyLanes(double *left, int leftstride, double *right, int rightstride, double *result, int resultstride)
+{
+	BATCH_Double r[9];
+	for(int e = 0; e < 9; e++) r[e] = BATCH_LOAD(right+(size_t)rightstride*e);
+	BATCH_Double products[9];
+	for(int i = 0; i < 3; i++)
+	{
+		BATCH_Double l0 = BATCH_LOAD(left+(size_t)leftstride*(3*i));
+		BATCH_Double l1 = BATCH_LOAD(left+(size_t)leftstride*(3*i+1));
+		BATCH_Double l2 = BATCH_LOAD(left+(size_t)leftstride*(3*i+2));
+		products[3*i] = BATCH_ADD(BATCH_ADD(BATCH_MUL(l0, r[0]), BATCH_MUL(l1, r[3])), BATCH_MUL(l2, r[6]));
+		products[3*i+1] = BATCH_ADD(BATCH_ADD(BATCH_MUL(l0, r[1]), BATCH_MUL(l1, r[4])), BATCH_MUL(l2, r[7]));
+		products[3*i+2] = BATCH_ADD(BATCH_ADD(BATCH_MUL(l0, r[2]), BATCH_MUL(l1, r[5])), BATCH_MUL(l2, r[8]));
+	}
+	for(int e = 0; e < 9; e++) BATCH_STORE(result+(size_t)resultstride*e, products[e]);
+}
+
+// computes the inverses or their transposes, or the determinants, of BATCH_LANES 3x3 matrices
+// the cofactors are those Cofactors finds, so the inverses are those M3D_InverseAffine makes of the upper left 3x3
+// takes a pointer to the first operand and its stride, a pointer to the first result and its stride (or NULL for none),
+// whether to store the inverses transposed, and a pointer to receive the lanes of the determinants
+void Batch3InverseLanes(double *operand, int stride, double *result, int resultstride, int transpose, BATCH_Double *determinant)
+{
+	BATCH_Double a[9];
+	for(int e = 0; e < 9; e++) a[e] = BATCH_LOAD(operand+(size_t)stride*e);
+	BATCH_Double cofactors[9];
+	cofactors[0] = BATCH_MINOR(a[4], a[8], a[5], a[7]);
+	cofactors[1] = BATCH_MINOR(a[5], a[6], a[3], a[8]);
+	cofactors[2] = BATCH_MINOR(a[3], a[7], a[4], a[6]);
+	cofactors[3] = BATCH_MINOR(a[2], a[7], a[1], a[8]);
+	cofactors[4] = BATCH_MINOR(a[0], a[8], a[2], a[6]);
+	cofactors[5] = BATCH_MINOR(a[1], a[6], a[0], a[7]);
+	cofactors[6] = BATCH_MINOR(a[1], a[5], a[2], a[4]);
+	cofactors[7] = BATCH_MINOR(a[2], a[3], a[0], a[5]);
+	cofactors[8] = BATCH_MINOR(a[0], a[4], a[1], a[3]);
+	BATCH_Double det = BATCH_ADD(BATCH_ADD(BATCH_MUL(a[0], cofactors[0]), BATCH_MUL(a[1], cofactors[1])), BATCH_MUL(a[2], cofactors[2]));
+	*determinant = det;
+	if(!result) return;
+	// the inverse is the transposed cofactors over the determinant, so the inverse transpose takes them in place
+	BATCH_Double scl = BATCH_DIV(BATCH_SET(1.0), det);
+	for(int e = 0; e < 9; e++)
+	{
+		int source = transpose ? e : 3*(e%3)+e/3;
+		BATCH_STORE(result+(size_t)resultstride*e, BATCH_MUL(scl, cofactors[source]));
+	}
+}
+
+void M3D_Batch3Pack(M3D_Matrix *matrices, int count, double *batch, int stride)
+{
+	for(int k = 0; k < count; k++)
+	{
+		for(int e = 0; e < 9; e++) batch[(size_t)stride*e+k] = matrices[k][e/3][e%3];
+	}
+}
+
+void M3D_Batch3Unpack(double *batch, int stride, int count, M3D_Matrix *matrices)
+{
+	for(int k = 0; k < count; k++)
+	{
+		for(int e = 0; e < 16; e++) matrices[k][e/4][e%4] = e/4 < 3 && e%4 < 3 ? batch[(size_t)stride*(3*(e/4)+e%4)+k] : e/4 == e%4;
+	}
+}
+
+void M3D_Batch3Multiply(int count, double *left, double *right, double *result, int stride)
+{
+	int k = 0;
+	for(; k+BATCH_LANES <= count; k += BATCH_LANES) Batch3MultiplyLanes(left+k, stride, right+k, stride, result+k, stride);
+	if(k < count)
+	{
+		double blocks[3][9*BATCH_LANES];
+		BatchTail(left+k, stride, 9, count-k, blocks[0], 1);
+		BatchTail(right+k, stride, 9, count-k, blocks[1], 1);
+		Batch3MultiplyLanes(blocks[0], BATCH_LANES, blocks[1], BATCH_LANES, blocks[2], BATCH_LANES);
+		BatchTail(result+k, stride, 9, count-k, blocks[2], 0);
+	}
+}
+
+// inverts a batch of 3x3 matrices or finds their determinants, as BatchInverse does for 4x4
+// takes the number of matrices, the operand batch, the result batch or NULL, their stride, whether to transpose, and an array for determinants or NULL
+void Batch3Inverse(int count, double *operand, double *result, int stride, int transpose, double *determinants)
+{
+	for(int k = 0; k < count; k += BATCH_LANES)
+	{
+		double blocks[2][9*BATCH_LANES];
+		double *source = operand+k;
+		double *destination = result ? result+k : NULL;
+		int sourcestride = stride;
+		int destinationstride = stride;
+		int lanes = count-k < BATCH_LANES ? count-k : BATCH_LANES;
+		// the last few matrices go through blocks of full width
+		if(lanes < BATCH_LANES)
+		{
+			BatchTail(source, stride, 9, lanes, blocks[0], 1);
+			source = blocks[0];
+			sourcestride = BATCH_LANES;
+			if(result) destination = blocks[1];
+			destinationstride = BATCH_LANES;
+		}
+		BATCH_Double determinant;
+		Batch3InverseLanes(source, sourcestride, destination, destinationstride, transpose, &determinant);
+		if(result && lanes < BATCH_LANES) BatchTail(result+k, stride, 9, lanes, blocks[1], 0);
+		if(determinants)
+		{
+			double values[BATCH_LANES];
+			BATCH_STORE(values, determinant);
+			for(int l = 0; l < lanes; l++) determinants[k+l] = values[l];
+		}
+	}
+}
+
+void M3D_Batch3Inverse(int count, double *operand, double *result, int stride)
+{
+	Batch3Inverse(count, operand, result, stride, 0, NULL);
+}
+
+void M3D_Batch3InverseTranspose(int count, double *operand, double *result, int stride)
+{
+	Batch3Inverse(count, operand, result, stride, 1, NULL);
+}
+
+void M3D_Batch3Determinant(int count, double *operand, int stride, double *determinants)
+{
+	Batch3Inverse(count, operand, NULL, stride, 0, determinants);
+}
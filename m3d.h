@@ -22,6 +22,33 @@ typedef double M3D_Matrix[4][4];
 // takes pointers to the left operand matrix, right operand vector, and result vector (may not be same as right operand)
 void M3D_Transform(M3D_Matrix *left, M3D_Vector *right, M3D_Vector *result);
 
+// transforms a stream of points (may not be normalized) by a matrix, four components each
+// takes a pointer to the matrix, a pointer to the first point, the number of doubles from one point to the next, the number of points,
+// a pointer to the first result and the number of doubles from one result to the next (may be the same as the points)
+// vectorized where AVX is available unless M3D_SCALAR is defined, the results are the same either way
+void M3D_TransformPoints(M3D_Matrix *left, double *points, int stride, int count, double *results, int resultstride);
+
+// transforms a stream of directions by a matrix as vectors with w=0, reading and writing only three components each
+// takes the same arguments as M3D_TransformPoints
+void M3D_TransformDirections(M3D_Matrix *left, double *directions, int stride, int count, double *results, int resultstride);
+
+// transforms points stored as a structure of arrays by a matrix
+// takes a pointer to the matrix, pointers to the arrays of x, y, z, and w components, the number of points,
+// and pointers to the arrays of result components (may be the same as the operands)
+void M3D_TransformPointsSoA(M3D_Matrix *left, double *x, double *y, double *z, double *w, int count, double *rx, double *ry, double *rz, double *rw);
+
+// transforms directions stored as a structure of arrays by a matrix as vectors with w=0
+// takes a pointer to the matrix, pointers to the arrays of x, y, and z components, the number of directions,
+// and pointers to the arrays of result components (may be the same as the operands)
+void M3D_TransformDirectionsSoA(M3D_Matrix *left, double *x, double *y, double *z, int count, double *rx, double *ry, double *rz);
+
+// single precision variants of the stream transforms, for pipelines working in float
+// take the same arguments with float streams, the matrix being converted once per call
+void M3D_TransformPointsF(M3D_Matrix *left, float *points, int stride, int count, float *results, int resultstride);
+void M3D_TransformDirectionsF(M3D_Matrix *left, float *directions, int stride, int count, float *results, int resultstride);
+void M3D_TransformPointsSoAF(M3D_Matrix *left, float *x, float *y, float *z, float *w, int count, float *rx, float *ry, float *rz, float *rw);
+void M3D_TransformDirectionsSoAF(M3D_Matrix *left, float *x, float *y, float *z, int count, float *rx, float *ry, float *rz);
+
 // adds two vectors
 // takes pointers to the left and right operand vectors and a result vector
 void M3D_Add(M3D_Vector *left, M3D_Vector *right, M3D_Vector *result);
@@ -90,10 +117,39 @@ void M3D_Inverse(M3D_Matrix *operand, M3D_Matrix *result);
 // takes pointers to the operand and result matrices (may not be the same)
 void M3D_Transpose(M3D_Matrix *operand, M3D_Matrix *result);
 
+// finds the inverse of an affine matrix (bottom row 0,0,0,1), such as those built by M3D_World, M3D_Translate, M3D_Rotate*, and M3D_Scale
+// inverts the upper left 3x3 by cofactors and carries the translation through it, a fraction of the work of M3D_Inverse
+// takes pointers to the operand and result matrices (may not be the same)
+void M3D_InverseAffine(M3D_Matrix *operand, M3D_Matrix *result);
+
+// finds the inverse of a rigid matrix (a rotation and a translation, no scaling), by transposing the rotation
+// takes pointers to the operand and result matrices (may not be the same)
+void M3D_InverseRigid(M3D_Matrix *operand, M3D_Matrix *result);
+
+// tests whether a matrix is affine, its bottom row being exactly 0,0,0,1
+// takes a pointer to the matrix
+// returns 1 if affine, otherwise 0
+int M3D_Affine(M3D_Matrix *operand);
+
+// largest difference from 0 or 1 allowed in the dot products of the rows of a rigid matrix's upper left 3x3, for rounding in rotations built from sines and cosines
+#define M3D_RIGID_TOLERANCE 1e-12
+
+// tests whether a matrix is rigid, being affine with the rows of its upper left 3x3 orthonormal to within M3D_RIGID_TOLERANCE
+// takes a pointer to the matrix
+// returns 1 if rigid, otherwise 0
+int M3D_Rigid(M3D_Matrix *operand);
+
 // finds the inverse transpose of a matrix (used for transforming normals)
+// rigid matrices take the path of M3D_InverseRigid, other affine matrices that of M3D_InverseAffine
 // takes pointers to the operand and result matrices (may not be the same)
 void M3D_InverseTranspose(M3D_Matrix *operand, M3D_Matrix *result);
 
+// finds a matrix for transforming normals with M3D_TransformDirections
+// for an affine matrix this is the inverse transpose of its upper left 3x3 alone, with the rest of the result set to identity,
+// copied unchanged for a rigid matrix, a rotation being its own inverse transpose, otherwise it is the full inverse transpose
+// takes pointers to the operand and result matrices (may not be the same)
+void M3D_NormalMatrix(M3D_Matrix *operand, M3D_Matrix *result);
+
 // finds the product of two matrices
 // takes pointers to the left and right operands and result matrix (may not be same to either operand)
 void M3D_Multiply(M3D_Matrix *left, M3D_Matrix *right, M3D_Matrix *result);
@@ -106,4 +162,113 @@ void M3D_Perspective(double top, double bottom, double left, double right, doubl
 // takes bounds for the top, bottom, left, right, near, and far planes, and a pointer to the result matrix
 void M3D_Orthographic(double top, double bottom, double left, double right, double near, double far, M3D_Matrix *result);
 
+// type for transform hierarchy
+// nodes are kept in a flat array with every parent before its children, so one pass in order updates them all
+// each node has a local matrix relative to its parent, and a world matrix and normal matrix computed from it
+// stamps record the generation of the update which last recomputed a node, nodes set since are stamped with the next generation
+typedef struct
+{
+	int count;
+	int capacity;
+	int *parents;
+	M3D_Matrix *locals;
+	M3D_Matrix *worlds;
+	M3D_Matrix *normals;
+	unsigned int *stamps;
+	unsigned int generation;
+	// the nodes ordered for parallel updates, the trunk of nodes with subtrees too large for one batch first and then the rest grouped into batches
+	int *order;
+	int trunk;
+	int *batches;
+	int batchcount;
+	int ordered;
+} M3D_Hierarchy;
+
+// initializes an empty transform hierarchy
+// takes a pointer to the hierarchy and the number of nodes to make room for (grown as needed)
+void M3D_HierarchyInitialize(M3D_Hierarchy *hierarchy, int capacity);
+
+// adds a node to a transform hierarchy, to be computed by the next update
+// takes a pointer to the hierarchy, the index of the parent node or -1 for a root, and a pointer to the local matrix
+// returns the index of the node
+int M3D_HierarchyInsert(M3D_Hierarchy *hierarchy, int parent, M3D_Matrix *local);
+
+// sets the local matrix of a node, marking its subtree to be recomputed by the next update
+// takes a pointer to the hierarchy, the index of the node, and a pointer to the local matrix
+void M3D_HierarchySetLocal(M3D_Hierarchy *hierarchy, int node, M3D_Matrix *local);
+
+// recomputes the world and normal matrices of the nodes set since the last update and of their descendants, leaving the rest untouched
+// a node's matrices were recomputed by the last update if its stamp equals the hierarchy's generation
+// takes a pointer to the hierarchy
+void M3D_HierarchyUpdate(M3D_Hierarchy *hierarchy);
+
+// updates a transform hierarchy as M3D_HierarchyUpdate does, with its subtrees shared among threads
+// nodes whose subtrees are too large for one batch are updated first by the calling thread, and the subtrees below them split among the threads,
+// so a hierarchy under a single root scales as well as one with many roots
+// takes a pointer to the hierarchy and the number of threads to update with (including the calling thread)
+void M3D_HierarchyUpdateParallel(M3D_Hierarchy *hierarchy, int threads);
+
+// frees the memory held by a transform hierarchy
+// takes a pointer to the hierarchy
+void M3D_HierarchyClean(M3D_Hierarchy *hierarchy);
+
+// batches hold many matrices interleaved by element, element (i,j) of matrix k at batch[stride*(4*i+j)+k], stride being at least the number of matrices,
+// so that the batch operations work on several matrices at once in SIMD lanes, vectorized where AVX is available unless M3D_SCALAR is defined
+// products are the same as M3D_Multiply's, inverses and determinants are found from 2x2 minors and agree with M3D_Inverse's and M3D_Determinant's to rounding
+// results may be the same batch as an operand
+
+// copies matrices into a batch
+// takes a pointer to the matrices, the number of matrices, a pointer to the batch, and its stride
+void M3D_BatchPack(M3D_Matrix *matrices, int count, double *batch, int stride);
+
+// copies matrices out of a batch
+// takes a pointer to the batch, its stride, the number of matrices, and a pointer to the matrices
+void M3D_BatchUnpack(double *batch, int stride, int count, M3D_Matrix *matrices);
+
+// finds the products of the matrices of two batches, as M3D_Multiply does
+// takes the number of matrices, the left and right operand batches, the result batch, and the stride of all three
+void M3D_BatchMultiply(int count, double *left, double *right, double *result, int stride);
+
+// finds the inverses of the matrices of a batch
+// takes the number of matrices, the operand and result batches, and the stride of both
+void M3D_BatchInverse(int count, double *operand, double *result, int stride);
+
+// finds the inverse transposes of the matrices of a batch (used for transforming normals)
+// takes the number of matrices, the operand and result batches, and the stride of both
+void M3D_BatchInverseTranspose(int count, double *operand, double *result, int stride);
+
+// finds the determinants of the matrices of a batch
+// takes the number of matrices, the operand batch, its stride, and an array for the determinants
+void M3D_BatchDeterminant(int count, double *operand, int stride, double *determinants);
+
+// 3x3 batches hold the upper left 3x3 of many matrices interleaved by element in the same way, element (i,j) of matrix k at batch[stride*(3*i+j)+k],
+// for the linear parts of affine matrices and for normal matrices, which need no fourth row or column
+// for affine matrices, products equal the upper left 3x3 of M3D_Multiply's, inverses that of M3D_InverseAffine's,
+// and inverse transposes that of M3D_NormalMatrix's for matrices that are not rigid, determinants agree with M3D_Determinant's to rounding
+// results may be the same batch as an operand
+
+// copies the upper left 3x3 of matrices into a 3x3 batch
+// takes a pointer to the matrices, the number of matrices, a pointer to the batch, and its stride
+void M3D_Batch3Pack(M3D_Matrix *matrices, int count, double *batch, int stride);
+
+// copies matrices out of a 3x3 batch into the upper left 3x3 of matrices, the rest of each set to identity as M3D_NormalMatrix leaves it
+// takes a pointer to the batch, its stride, the number of matrices, and a pointer to the matrices
+void M3D_Batch3Unpack(double *batch, int stride, int count, M3D_Matrix *matrices);
+
+// finds the products of the matrices of two 3x3 batches
+// takes the number of matrices, the left and right operand batches, the result batch, and the stride of all three
+void M3D_Batch3Multiply(int count, double *left, double *right, double *result, int stride);
+
+// finds the inverses of the matrices of a 3x3 batch
+// takes the number of matrices, the operand and result batches, and the stride of both
+void M3D_Batch3Inverse(int count, double *operand, double *result, int stride);
+
+// finds the inverse transposes of the matrices of a 3x3 batch, the normal matrices of the affine matrices they were packed from
+// takes the number of matrices, the operand and result batches, and the stride of both
+void M3D_Batch3InverseTranspose(int count, double *operand, double *result, int stride);
+
+// finds the determinants of the matrices of a 3x3 batch
+// takes the number of matrices, the operand batch, its stride, and an array for the determinants
+void M3D_Batch3Determinant(int count, double *operand, int stride, double *determinants);
+
 #endif
@@ -0,0 +1,118 @@
+/*
+Header only inline layer over m3d for hot loops
+Functions here are static inline so calls with constant matrices fold and chained products keep their temporaries in registers
+Layouts are those of M3D_Matrix and M3D_Vector, so the two layers mix freely
+
+Copyright (C) 2015 Kyle Gagner
+All rights reserved
+*/
+
+// include guard
+#ifndef M3DI_H
+#define M3DI_H
+
+#include "m3d.h"
+
+// initializers for constant matrices, constant expressions when their arguments are, for static M3D_Matrix definitions folded at compile time
+// each gives the same matrix as the m3d constructor it is named after, arguments being taken as doubles
+#define M3DI_IDENTITY {{1, 0, 0, 0}, {0, 1, 0, 0}, {0, 0, 1, 0}, {0, 0, 0, 1}}
+#define M3DI_TRANSLATE(x, y, z) {{1, 0, 0, (x)}, {0, 1, 0, (y)}, {0, 0, 1, (z)}, {0, 0, 0, 1}}
+#define M3DI_SCALE(x, y, z) {{(x), 0, 0, 0}, {0, (y), 0, 0}, {0, 0, (z), 0}, {0, 0, 0, 1}}
+#define M3DI_PERSPECTIVE(top, bottom, left, right, near, far) \
+	{{2.0*(near)/((double)(left)-(right)), 0, ((double)(right)+(left))/((double)(right)-(left)), 0}, \
+	{0, 2.0*(near)/((double)(bottom)-(top)), ((double)(top)+(bottom))/((double)(top)-(bottom)), 0}, \
+	{0, 0, ((double)(far)+(near))/((double)(far)-(near)), 2.0*(far)*(near)/((double)(near)-(far))}, \
+	{0, 0, -1, 0}}
+#define M3DI_ORTHOGRAPHIC(top, bottom, left, right, near, far) \
+	{{2.0/((double)(right)-(left)), 0, 0, ((double)(right)+(left))/((double)(left)-(right))}, \
+	{0, 2.0/((double)(top)-(bottom)), 0, ((double)(top)+(bottom))/((double)(bottom)-(top))}, \
+	{0, 0, 2.0/((double)(near)-(far)), ((double)(far)+(near))/((double)(near)-(far))}, \
+	{0, 0, 0, 1}}
+
+// finds the product of two matrices, as M3D_Multiply does
+// takes pointers to the left and right operands and result matrix (may not be same to either operand)
+static inline void M3DI_Multiply(M3D_Matrix *left, M3D_Matrix *right, M3D_Matrix *result)
+{
+	for(int i = 0; i < 4; i++)
+	{
+		for(int j = 0; j < 4; j++)
+		{
+			(*result)[i][j] = (*left)[i][0] * (*right)[0][j] + (*left)[i][1] * (*right)[1][j] + (*left)[i][2] * (*right)[2][j] + (*left)[i][3] * (*right)[3][j];
+		}
+	}
+}
+
+// finds the product of three matrices, left*(middle*right), without a 4x4 temporary
+// the product is built a column at a time, each column of middle*right kept only until the column of the result is made from it,
+// and rounds exactly as two M3D_Multiply calls would, for example projection*(view*world)
+// takes pointers to the three operands and the result matrix (may not be same to any operand)
+static inline void M3DI_Multiply3(M3D_Matrix *left, M3D_Matrix *middle, M3D_Matrix *right, M3D_Matrix *result)
+{
+	for(int j = 0; j < 4; j++)
+	{
+		double column[4];
+		for(int k = 0; k < 4; k++)
+		{
+			column[k] = (*middle)[k][0] * (*right)[0][j] + (*middle)[k][1] * (*right)[1][j] + (*middle)[k][2] * (*right)[2][j] + (*middle)[k][3] * (*right)[3][j];
+		}
+		for(int i = 0; i < 4; i++)
+		{
+			(*result)[i][j] = (*left)[i][0] * column[0] + (*left)[i][1] * column[1] + (*left)[i][2] * column[2] + (*left)[i][3] * column[3];
+		}
+	}
+}
+
+// transforms a point of four components by a matrix, as M3D_Transform does
+// takes a pointer to the matrix, a pointer to the point, and a pointer to the result (may not be the same as the point)
+static inline void M3DI_TransformPoint(M3D_Matrix *left, double *point, double *result)
+{
+	for(int i = 0; i < 4; i++)
+	{
+		result[i] = (*left)[i][0] * point[0] + (*left)[i][1] * point[1] + (*left)[i][2] * point[2] + (*left)[i][3] * point[3];
+	}
+}
+
+// transforms a direction of three components by a matrix as a vector with w=0
+// takes a pointer to the matrix, a pointer to the direction, and a pointer to the result (may not be the same as the direction)
+static inline void M3DI_TransformDirection(M3D_Matrix *left, double *direction, double *result)
+{
+	for(int i = 0; i < 3; i++)
+	{
+		result[i] = (*left)[i][0] * direction[0] + (*left)[i][1] * direction[1] + (*left)[i][2] * direction[2];
+	}
+}
+
+// transforms a point through a chain of three matrices, right first, with no matrix product formed
+// three matrix vector products cost 48 multiplies against the 128 of forming the chain's product, for points transformed once per chain
+// results may differ from transforming by the product in the last bits
+// takes pointers to the left, middle, and right matrices, a pointer to the point, and a pointer to the result (may be the same as the point)
+static inline void M3DI_TransformPoint3(M3D_Matrix *left, M3D_Matrix *middle, M3D_Matrix *right, double *point, double *result)
+{
+	double first[4];
+	double second[4];
+	M3DI_TransformPoint(right, point, first);
+	M3DI_TransformPoint(middle, first, second);
+	M3DI_TransformPoint(left, second, result);
+}
+
+// transforms a stream of points by a matrix, as M3D_TransformPoints does
+// inlined, a matrix known at compile time is folded into the loop
+// takes a pointer to the matrix, a pointer to the first point, the number of doubles from one point to the next, the number of points,
+// a pointer to the first result and the number of doubles from one result to the next (may be the same as the points)
+static inline void M3DI_TransformPoints(M3D_Matrix *left, double *points, int stride, int count, double *results, int resultstride)
+{
+	M3D_Matrix matrix;
+	for(int i = 0; i < 4; i++)
+	{
+		for(int j = 0; j < 4; j++) matrix[i][j] = (*left)[i][j];
+	}
+	for(int n = 0; n < count; n++)
+	{
+		double point[4] = {points[0], points[1], points[2], points[3]};
+		M3DI_TransformPoint(&matrix, point, results);
+		points += stride;
+		results += resultstride;
+	}
+}
+
+#endif
@@ -0,0 +1,123 @@
+/*
+Template for the stream transforms of m3d, included by m3d.c once for each precision
+Before including, REAL names the element type, REAL_NAME(name) names a function of that precision,
+and where vectorized (M3D_VECTOR defined), VEC4 is a vector of four elements and VECN one of VECN_LANES elements
+with operations named after them
+
+Copyright (C) 2015 Kyle Gagner
+All rights reserved
+*/
+
+void REAL_NAME(M3D_TransformPoints)(M3D_Matrix *left, REAL *points, int stride, int count, REAL *results, int resultstride)
+{
+#ifdef M3D_VECTOR
+	// columns of the matrix, the result is the sum of each scaled by a component of the point
+	VEC4 columns[4];
+	for(int j = 0; j < 4; j++) columns[j] = VEC4_SET((*left)[0][j], (*left)[1][j], (*left)[2][j], (*left)[3][j]);
+	for(int n = 0; n < count; n++)
+	{
+		REAL *point = points+(size_t)stride*n;
+		VEC4 result = VEC4_MUL(columns[0], VEC4_BROADCAST(point));
+		result = VEC4_ADD(result, VEC4_MUL(columns[1], VEC4_BROADCAST(point+1)));
+		result = VEC4_ADD(result, VEC4_MUL(columns[2], VEC4_BROADCAST(point+2)));
+		result = VEC4_ADD(result, VEC4_MUL(columns[3], VEC4_BROADCAST(point+3)));
+		VEC4_STORE(results+(size_t)resultstride*n, result);
+	}
+#else
+	// a copy of the matrix, which the compiler can keep in registers as the results cannot overwrite it
+	REAL matrix[4][4];
+	for(int i = 0; i < 4; i++) for(int j = 0; j < 4; j++) matrix[i][j] = (*left)[i][j];
+	for(int n = 0; n < count; n++)
+	{
+		REAL *point = points+(size_t)stride*n;
+		REAL *result = results+(size_t)resultstride*n;
+		REAL x = point[0], y = point[1], z = point[2], w = point[3];
+		for(int i = 0; i < 4; i++) result[i] = matrix[i][0] * x + matrix[i][1] * y + matrix[i][2] * z + matrix[i][3] * w;
+	}
+#endif
+}
+
+void REAL_NAME(M3D_TransformDirections)(M3D_Matrix *left, REAL *directions, int stride, int count, REAL *results, int resultstride)
+{
+#ifdef M3D_VECTOR
+	VEC4 columns[3];
+	for(int j = 0; j < 3; j++) columns[j] = VEC4_SET((*left)[0][j], (*left)[1][j], (*left)[2][j], 0.0);
+	for(int n = 0; n < count; n++)
+	{
+		REAL *direction = directions+(size_t)stride*n;
+		VEC4 result = VEC4_MUL(columns[0], VEC4_BROADCAST(direction));
+		result = VEC4_ADD(result, VEC4_MUL(columns[1], VEC4_BROADCAST(direction+1)));
+		result = VEC4_ADD(result, VEC4_MUL(columns[2], VEC4_BROADCAST(direction+2)));
+		// the w component is neither read nor written
+		VEC4_STORE3(results+(size_t)resultstride*n, result);
+	}
+#else
+	REAL matrix[4][4];
+	for(int i = 0; i < 4; i++) for(int j = 0; j < 4; j++) matrix[i][j] = (*left)[i][j];
+	for(int n = 0; n < count; n++)
+	{
+		REAL *direction = directions+(size_t)stride*n;
+		REAL *result = results+(size_t)resultstride*n;
+		REAL x = direction[0], y = direction[1], z = direction[2];
+		for(int i = 0; i < 3; i++) result[i] = matrix[i][0] * x + matrix[i][1] * y + matrix[i][2] * z;
+	}
+#endif
+}
+
+void REAL_NAME(M3D_TransformPointsSoA)(M3D_Matrix *left, REAL *x, REAL *y, REAL *z, REAL *w, int count, REAL *rx, REAL *ry, REAL *rz, REAL *rw)
+{
+	REAL *results[4] = {rx, ry, rz, rw};
+	REAL matrix[4][4];
+	for(int i = 0; i < 4; i++) for(int j = 0; j < 4; j++) matrix[i][j] = (*left)[i][j];
+	int n = 0;
+#ifdef M3D_VECTOR
+	// a point to each lane
+	VECN elements[4][4];
+	for(int i = 0; i < 4; i++) for(int j = 0; j < 4; j++) elements[i][j] = VECN_SET(matrix[i][j]);
+	for(; n+VECN_LANES <= count; n += VECN_LANES)
+	{
+		VECN vx = VECN_LOAD(x+n), vy = VECN_LOAD(y+n), vz = VECN_LOAD(z+n), vw = VECN_LOAD(w+n);
+		for(int i = 0; i < 4; i++)
+		{
+			VECN result = VECN_MUL(elements[i][0], vx);
+			result = VECN_ADD(result, VECN_MUL(elements[i][1], vy));
+			result = VECN_ADD(result, VECN_MUL(elements[i][2], vz));
+			result = VECN_ADD(result, VECN_MUL(elements[i][3], vw));
+			VECN_STORE(results[i]+n, result);
+		}
+	}
+#endif
+	for(; n < count; n++)
+	{
+		REAL cx = x[n], cy = y[n], cz = z[n], cw = w[n];
+		for(int i = 0; i < 4; i++) results[i][n] = matrix[i][0] * cx + matrix[i][1] * cy + matrix[i][2] * cz + matrix[i][3] * cw;
+	}
+}
+
+void REAL_NAME(M3D_TransformDirectionsSoA)(M3D_Matrix *left, REAL *x, REAL *y, REAL *z, int count, REAL *rx, REAL *ry, REAL *rz)
+{
+	REAL *results[3] = {rx, ry, rz};
+	REAL matrix[3][3];
+	for(int i = 0; i < 3; i++) for(int j = 0; j < 3; j++) matrix[i][j] = (*left)[i][j];
+	int n = 0;
+#ifdef M3D_VECTOR
+	VECN elements[3][3];
+	for(int i = 0; i < 3; i++) for(int j = 0; j < 3; j++) elements[i][j] = VECN_SET(matrix[i][j]);
+	for(; n+VECN_LANES <= count; n += VECN_LANES)
+	{
+		VECN vx = VECN_LOAD(x+n), vy = VECN_LOAD(y+n), vz = VECN_LOAD(z+n);
+		for(int i = 0; i < 3; i++)
+		{
+			VECN result = VECN_MUL(elements[i][0], vx);
+			result = VECN_ADD(result, VECN_MUL(elements[i][1], vy));
+			result = VECN_ADD(result, VECN_MUL(elements[i][2], vz));
+			VECN_STORE(results[i]+n, result);
+		}
+	}
+#endif
+	for(; n < count; n++)
+	{
+		REAL cx = x[n], cy = y[n], cz = z[n];
+		for(int i = 0; i < 3; i++) results[i][n] = matrix[i][0] * cx + matrix[i][1] * cy + matrix[i][2] * cz;
+	}
+}
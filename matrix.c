@@ -1,15 +1,21 @@
 /*
-Header file for matrix operations
-Not intended for performance critical applications
+Source file for matrix operations
+Multiplication is blocked and vectorized, as are the LU and Cholesky factorizations through it
 
 Copyright (C) 2015 Kyle Gagner
 All rights reserved
 */
 
+#include <stdlib.h>
+#include <math.h>
 #include <string.h>
 #include "matrix.h"
+#include "workers.h"
+#if !defined(MATRIX_SCALAR) && defined(__AVX__)
+#include <immintrin.h>
+#endif
 
-void MATRIX_Multiply(int n, int m, int p, double *left, double *right, double *result)
+void MATRIX_MultiplyReference(int n, int m, int p, double *left, double *right, double *result)
 {
 	for(int i = 0; i < n; i++)
 	{
@@ -22,68 +28,406 @@ void MATRIX_Multiply(int n, int m, int p, double *left, double *right, double *r
 	}
 }
 
-void MATRIX_Inverse(int n, double *operand, double *result)
+// rows and columns of the block of the result kept in registers by the micro kernel
+#define GEMM_MR 4
+#define GEMM_NR 8
+// rows of the left operand, depth, and columns of the right operand packed at a time, sized for the caches
+#define GEMM_MC 64
+#define GEMM_KC 256
+#define GEMM_NC 256
+// products below which packing costs more than it saves
+#define GEMM_SMALL 32768
+
+// work shared between the threads multiplying the tiles of one product
+typedef struct
+{
+	int n;
+	int m;
+	int p;
+	double *left;
+	double *right;
+	double *result;
+	int columns;
+	int tiles;
+	mtx_t lock;
+	int next;
+} GemmJob;
+
+// packs a block of the left operand into strips of GEMM_MR rows, each strip stored column by column, rows past the end zeroed
+// takes the row stride of the operand, a pointer to the block, its rows and depth, and the packed storage
+void GemmPackLeft(int stride, double *left, int rows, int depth, double *packed)
 {
-	int i, j, k;
-	double tmp;
-	double work[n*n];
-	memcpy(work, operand, n*n*sizeof(double));
-	for(i = 0; i < n; i++)
+	for(int i = 0; i < rows; i += GEMM_MR)
 	{
-		for(int j = 0; j < n; j++)
+		for(int k = 0; k < depth; k++)
 		{
-			result[n*i+j] = i==j ? 1.0 : 0.0;
+			for(int r = 0; r < GEMM_MR; r++) *packed++ = i+r < rows ? left[(size_t)stride*(i+r)+k] : 0.0;
 		}
 	}
-	for(i = 0; i < n; i++)
+}
+
+// packs a block of the right operand into strips of GEMM_NR columns, each strip stored row by row, columns past the end zeroed
+// takes the row stride of the operand, a pointer to the block, its depth and columns, and the packed storage
+void GemmPackRight(int stride, double *right, int depth, int columns, double *packed)
+{
+	for(int j = 0; j < columns; j += GEMM_NR)
 	{
-		for(k = i; work[n*k+i]==0 && k<n; k++);
-		if(k!=i)
+		for(int k = 0; k < depth; k++)
 		{
-			for(int j = i; j < n; j++)
-			{
-				tmp = work[n*i+j];
-				work[n*i+j] = work[n*k+j];
-				work[n*k+j] = tmp;
-				tmp = result[n*i+j];
-				result[n*i+j] = result[n*k+j];
-				result[n*k+j] = tmp;
-			}
+			for(int c = 0; c < GEMM_NR; c++) *packed++ = j+c < columns ? right[(size_t)stride*k+j+c] : 0.0;
+		}
+	}
+}
+
+// adds the product of a packed strip of the left operand and a packed strip of the right to a GEMM_MR by GEMM_NR block
+// each element's products are added one at a time in order of depth, as MATRIX_MultiplyReference adds them
+// takes the depth, the packed strips, a pointer to the block and its row stride
+void GemmKernel(int depth, double *left, double *right, double *block, int stride)
+{
+#if !defined(MATRIX_SCALAR) && defined(__AVX__)
+	__m256d sums[GEMM_MR][2];
+	for(int r = 0; r < GEMM_MR; r++)
+	{
+		sums[r][0] = _mm256_loadu_pd(block+stride*r);
+		sums[r][1] = _mm256_loadu_pd(block+stride*r+4);
+	}
+	for(int k = 0; k < depth; k++)
+	{
+		__m256d low = _mm256_loadu_pd(right+GEMM_NR*k);
+		__m256d high = _mm256_loadu_pd(right+GEMM_NR*k+4);
+		for(int r = 0; r < GEMM_MR; r++)
+		{
+			__m256d factor = _mm256_broadcast_sd(left+GEMM_MR*k+r);
+			sums[r][0] = _mm256_add_pd(sums[r][0], _mm256_mul_pd(factor, low));
+			sums[r][1] = _mm256_add_pd(sums[r][1], _mm256_mul_pd(factor, high));
 		}
-		tmp = 1.0 / work[n*i+i];
-		work[n*i+i] = 1.0;
-		for(j = i + 1; j < n; j++)
+	}
+	for(int r = 0; r < GEMM_MR; r++)
+	{
+		_mm256_storeu_pd(block+stride*r, sums[r][0]);
+		_mm256_storeu_pd(block+stride*r+4, sums[r][1]);
+	}
+#else
+	double sums[GEMM_MR][GEMM_NR];
+	for(int r = 0; r < GEMM_MR; r++)
+	{
+		for(int c = 0; c < GEMM_NR; c++) sums[r][c] = block[stride*r+c];
+	}
+	for(int k = 0; k < depth; k++)
+	{
+		for(int r = 0; r < GEMM_MR; r++)
 		{
-			work[n*i+j] *= tmp;
+			for(int c = 0; c < GEMM_NR; c++) sums[r][c] += left[GEMM_MR*k+r] * right[GEMM_NR*k+c];
 		}
-		for(j = 0; j < n; j++)
+	}
+	for(int r = 0; r < GEMM_MR; r++)
+	{
+		for(int c = 0; c < GEMM_NR; c++) block[stride*r+c] = sums[r][c];
+	}
+#endif
+}
+
+// computes one GEMM_MC by GEMM_NC tile of the result, packing the blocks of the operands it needs
+// takes the job, the tile's first row and column, and packing storage for each operand
+void GemmTile(GemmJob *job, int row, int column, double *packedleft, double *packedright)
+{
+	int rows = job->n-row < GEMM_MC ? job->n-row : GEMM_MC;
+	int columns = job->p-column < GEMM_NC ? job->p-column : GEMM_NC;
+	double *tile = job->result+(size_t)job->p*row+column;
+	for(int i = 0; i < rows; i++) memset(tile+(size_t)job->p*i, 0, columns*sizeof(double));
+	// the depth is split into blocks taken in order, so each element's sum runs through them as one sequence
+	for(int depth = 0; depth < job->m; depth += GEMM_KC)
+	{
+		int size = job->m-depth < GEMM_KC ? job->m-depth : GEMM_KC;
+		GemmPackLeft(job->m, job->left+(size_t)job->m*row+depth, rows, size, packedleft);
+		GemmPackRight(job->p, job->right+(size_t)job->p*depth+column, size, columns, packedright);
+		for(int j = 0; j < columns; j += GEMM_NR)
+		{
+			for(int i = 0; i < rows; i += GEMM_MR)
+			{
+				double *strip = packedleft+(size_t)i*size;
+				double *panel = packedright+(size_t)j*size;
+				if(i+GEMM_MR <= rows && j+GEMM_NR <= columns)
+				{
+					GemmKernel(size, strip, panel, tile+(size_t)job->p*i+j, job->p);
+					continue;
+				}
+				// blocks overhanging the edges of the result go through a full size copy
+				double block[GEMM_MR*GEMM_NR] = {0};
+				int height = rows-i < GEMM_MR ? rows-i : GEMM_MR;
+				int width = columns-j < GEMM_NR ? columns-j : GEMM_NR;
+				for(int r = 0; r < height; r++) memcpy(block+GEMM_NR*r, tile+(size_t)job->p*(i+r)+j, width*sizeof(double));
+				GemmKernel(size, strip, panel, block, GEMM_NR);
+				for(int r = 0; r < height; r++) memcpy(tile+(size_t)job->p*(i+r)+j, block+GEMM_NR*r, width*sizeof(double));
+			}
+		}
+	}
+}
+
+int GemmWorker(void *arg)
+{
+	GemmJob *job = arg;
+	double *packedleft = malloc(GEMM_MC*GEMM_KC*sizeof(double));
+	double *packedright = malloc(GEMM_KC*GEMM_NC*sizeof(double));
+	for(;;)
+	{
+		mtx_lock(&job->lock);
+		int tile = job->next++;
+		mtx_unlock(&job->lock);
+		if(tile >= job->tiles) break;
+		GemmTile(job, tile/job->columns*GEMM_MC, tile%job->columns*GEMM_NC, packedleft, packedright);
+	}
+	free(packedleft);
+	free(packedright);
+	return 0;
+}
+
+void MATRIX_MultiplyParallel(int n, int m, int p, double *left, double *right, double *result, int threads)
+{
+	if((long long)n*m*p < GEMM_SMALL)
+	{
+		MATRIX_MultiplyReference(n, m, p, left, right, result);
+		return;
+	}
+	int columns = (p+GEMM_NC-1)/GEMM_NC;
+	GemmJob job = {.n = n, .m = m, .p = p, .left = left, .right = right, .result = result, .columns = columns, .tiles = (n+GEMM_MC-1)/GEMM_MC*columns, .next = 0};
+	mtx_init(&job.lock, mtx_plain);
+	WORKERS_Run(GemmWorker, &job, threads);
+	mtx_destroy(&job.lock);
+}
+
+void MATRIX_Multiply(int n, int m, int p, double *left, double *right, double *result)
+{
+	MATRIX_MultiplyParallel(n, m, p, left, right, result, 1);
+}
+
+// number of columns eliminated together by the blocked factorizations, the rest of the matrix updated once per block by a product
+#define LU_BLOCK 64
+
+// swaps two rows of a matrix
+// takes the row length and pointers to the rows
+void SwapRows(int length, double *first, double *second)
+{
+	for(int j = 0; j < length; j++)
+	{
+		double tmp = first[j];
+		first[j] = second[j];
+		second[j] = tmp;
+	}
+}
+
+int MATRIX_LUFactor(int n, double *matrix, int *pivots)
+{
+	double *lower = malloc((size_t)LU_BLOCK*LU_BLOCK*sizeof(double));
+	double *upper = malloc((size_t)LU_BLOCK*n*sizeof(double));
+	double *product = malloc((size_t)LU_BLOCK*n*sizeof(double));
+	int regular = 1;
+	for(int block = 0; block < n && regular; block += LU_BLOCK)
+	{
+		int width = n-block < LU_BLOCK ? n-block : LU_BLOCK;
+		int end = block+width;
+		// the panel of the block's columns is eliminated column by column, pivot rows swapped whole
+		for(int j = block; j < end; j++)
 		{
-			result[n*i+j] *= tmp;
+			int pivot = j;
+			for(int k = j+1; k < n; k++)
+			{
+				if(fabs(matrix[(size_t)n*k+j]) > fabs(matrix[(size_t)n*pivot+j])) pivot = k;
+			}
+			pivots[j] = pivot;
+			if(matrix[(size_t)n*pivot+j] == 0)
+			{
+				regular = 0;
+				break;
+			}
+			if(pivot != j) SwapRows(n, matrix+(size_t)n*j, matrix+(size_t)n*pivot);
+			double *row = matrix+(size_t)n*j;
+			for(int k = j+1; k < n; k++)
+			{
+				double *current = matrix+(size_t)n*k;
+				current[j] /= row[j];
+				for(int c = j+1; c < end; c++) current[c] -= current[j] * row[c];
+			}
 		}
-		for(k = i + 1; k < n; k++)
+		if(!regular || end == n) break;
+		// the block's rows right of the panel are solved against its unit lower triangle
+		int rest = n-end;
+		for(int r = block; r < end; r++)
 		{
-			tmp = work[n*k+i];
-			work[n*k+i] = 0.0;
-			for(j = i + 1; j < n; j++)
+			double *row = matrix+(size_t)n*r;
+			for(int q = block; q < r; q++)
 			{
-				work[n*k+j] -= tmp * work[n*i+j];
+				double *source = matrix+(size_t)n*q;
+				for(int c = end; c < n; c++) row[c] -= row[q] * source[c];
 			}
-			for(j = 0; j < n; j++)
+			memcpy(upper+(size_t)rest*(r-block), row+end, rest*sizeof(double));
+		}
+		// and the trailing matrix takes the product of the panel below the block and those rows, a block of rows at a time
+		for(int first = end; first < n; first += LU_BLOCK)
+		{
+			int rows = n-first < LU_BLOCK ? n-first : LU_BLOCK;
+			for(int r = 0; r < rows; r++) memcpy(lower+width*r, matrix+(size_t)n*(first+r)+block, width*sizeof(double));
+			MATRIX_Multiply(rows, width, rest, lower, upper, product);
+			for(int r = 0; r < rows; r++)
 			{
-				result[n*k+j] -= tmp * result[n*i+j];
+				double *row = matrix+(size_t)n*(first+r)+end;
+				for(int c = 0; c < rest; c++) row[c] -= product[(size_t)rest*r+c];
 			}
 		}
 	}
-	for(i = n - 1; i >= 0; i--)
+	free(lower);
+	free(upper);
+	free(product);
+	return regular;
+}
+
+void MATRIX_LUSolve(int n, double *factors, int *pivots, int count, double *rhs)
+{
+	for(int i = 0; i < n; i++)
+	{
+		if(pivots[i] != i) SwapRows(count, rhs+(size_t)count*i, rhs+(size_t)count*pivots[i]);
+	}
+	// forward substitution through the unit lower triangle, then back substitution through the upper
+	for(int i = 0; i < n; i++)
+	{
+		double *row = rhs+(size_t)count*i;
+		for(int q = 0; q < i; q++)
+		{
+			double factor = factors[(size_t)n*i+q];
+			double *source = rhs+(size_t)count*q;
+			for(int c = 0; c < count; c++) row[c] -= factor * source[c];
+		}
+	}
+	for(int i = n-1; i >= 0; i--)
 	{
-		for(k = 0; k < i; k++)
+		double *row = rhs+(size_t)count*i;
+		for(int q = i+1; q < n; q++)
 		{
-			tmp = work[n*k+i];
-			work[n*k+i] = 0.0;
-			for(j = 0; j < n; j++)
+			double factor = factors[(size_t)n*i+q];
+			double *source = rhs+(size_t)count*q;
+			for(int c = 0; c < count; c++) row[c] -= factor * source[c];
+		}
+		double diagonal = factors[(size_t)n*i+i];
+		for(int c = 0; c < count; c++) row[c] /= diagonal;
+	}
+}
+
+int MATRIX_CholeskyFactor(int n, double *matrix)
+{
+	double *panel = malloc((size_t)LU_BLOCK*n*sizeof(double));
+	double *transpose = malloc((size_t)LU_BLOCK*LU_BLOCK*sizeof(double));
+	double *product = malloc((size_t)LU_BLOCK*n*sizeof(double));
+	int definite = 1;
+	for(int block = 0; block < n && definite; block += LU_BLOCK)
+	{
+		int width = n-block < LU_BLOCK ? n-block : LU_BLOCK;
+		int end = block+width;
+		// the diagonal block is factored row by row, the columns left of it having been taken out by earlier updates
+		for(int i = block; i < end && definite; i++)
+		{
+			double *row = matrix+(size_t)n*i;
+			for(int j = block; j <= i; j++)
 			{
-				result[n*k+j] -= tmp * result[n*i+j];
+				double *other = matrix+(size_t)n*j;
+				double sum = row[j];
+				for(int q = block; q < j; q++) sum -= row[q] * other[q];
+				if(j < i)
+				{
+					row[j] = sum / other[j];
+					continue;
+				}
+				if(sum <= 0)
+				{
+					definite = 0;
+					break;
+				}
+				row[i] = sqrt(sum);
 			}
 		}
+		if(!definite || end == n) break;
+		// the panel below it is solved against the transpose of its factor, and packed for the update
+		for(int i = end; i < n; i++)
+		{
+			double *row = matrix+(size_t)n*i;
+			for(int j = block; j < end; j++)
+			{
+				double *other = matrix+(size_t)n*j;
+				double sum = row[j];
+				for(int q = block; q < j; q++) sum -= row[q] * other[q];
+				row[j] = sum / other[j];
+			}
+			memcpy(panel+(size_t)width*(i-end), row+block, width*sizeof(double));
+		}
+		// and the lower triangle of the trailing matrix takes the product of the panel and its transpose, a block of columns at a time,
+		// each block multiplied only by the rows of the panel from its first column down
+		for(int first = end; first < n; first += LU_BLOCK)
+		{
+			int columns = n-first < LU_BLOCK ? n-first : LU_BLOCK;
+			int rows = n-first;
+			double *left = panel+(size_t)width*(first-end);
+			for(int q = 0; q < width; q++)
+			{
+				for(int c = 0; c < columns; c++) transpose[columns*q+c] = left[width*c+q];
+			}
+			MATRIX_Multiply(rows, width, columns, left, transpose, product);
+			for(int r = 0; r < rows; r++)
+			{
+				double *row = matrix+(size_t)n*(first+r)+first;
+				int last = r < columns ? r+1 : columns;
+				for(int c = 0; c < last; c++) row[c] -= product[(size_t)columns*r+c];
+			}
+		}
+	}
+	free(panel);
+	free(transpose);
+	free(product);
+	return definite;
+}
+
+void MATRIX_CholeskySolve(int n, double *factors, int count, double *rhs)
+{
+	// forward substitution through the lower triangle, then back substitution through its transpose
+	for(int i = 0; i < n; i++)
+	{
+		double *row = rhs+(size_t)count*i;
+		for(int q = 0; q < i; q++)
+		{
+			double factor = factors[(size_t)n*i+q];
+			double *source = rhs+(size_t)count*q;
+			for(int c = 0; c < count; c++) row[c] -= factor * source[c];
+		}
+		double diagonal = factors[(size_t)n*i+i];
+		for(int c = 0; c < count; c++) row[c] /= diagonal;
+	}
+	for(int i = n-1; i >= 0; i--)
+	{
+		double *row = rhs+(size_t)count*i;
+		for(int q = i+1; q < n; q++)
+		{
+			double factor = factors[(size_t)n*q+i];
+			double *source = rhs+(size_t)count*q;
+			for(int c = 0; c < count; c++) row[c] -= factor * source[c];
+		}
+		double diagonal = factors[(size_t)n*i+i];
+		for(int c = 0; c < count; c++) row[c] /= diagonal;
+	}
+}
+
+int MATRIX_Inverse(int n, double *operand, double *result)
+{
+	double *factors = malloc((size_t)n*n*sizeof(double));
+	int *pivots = malloc(n*sizeof(int));
+	memcpy(factors, operand, (size_t)n*n*sizeof(double));
+	for(int i = 0; i < n; i++)
+	{
+		for(int j = 0; j < n; j++)
+		{
+			result[(size_t)n*i+j] = i==j ? 1.0 : 0.0;
+		}
 	}
+	int regular = MATRIX_LUFactor(n, factors, pivots);
+	if(regular) MATRIX_LUSolve(n, factors, pivots, n, result);
+	free(factors);
+	free(pivots);
+	return regular;
 }
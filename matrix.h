@@ -1,6 +1,6 @@
 /*
 Header file for matrix operations
-Not intended for performance critical applications
+Multiplication is blocked and vectorized, as are the LU and Cholesky factorizations through it
 
 Copyright (C) 2015 Kyle Gagner
 All rights reserved
@@ -9,7 +9,7 @@ All rights reserved
 
 // include guard
 #ifndef MATRIX_H
-#define MATRIX
+#define MATRIX_H
 
 /*
 A matrix is simply a pointer to a flat array of double values
@@ -17,11 +17,46 @@ A matrix is interpreted as being in row major order
 */
 
 // multiplies an n by m matrix by an m by p matrix to get an n by p result
-// takes n, m, p, the left and right operand matrices, and the result matrix
+// the operands are packed into cache sized blocks and multiplied a register block at a time, vectorized where AVX is available unless MATRIX_SCALAR is defined
+// each element's products are summed in the same order as by MATRIX_MultiplyReference, so the results are identical to it
+// as long as the compiler does not contract multiplies and adds (the default for standard C modes, -ffp-contract=off otherwise),
+// with contraction allowed they may differ from it by the rounding of the contracted additions, a few ulps of the sum of |left*right| terms
+// takes n, m, p, the left and right operand matrices, and the result matrix (may not be the same as either operand)
 void MATRIX_Multiply(int n, int m, int p, double *left, double *right, double *result);
 
-// inverts and n by n matrix
-// takes n, the operand matrix, and the result matrix
-void MATRIX_Inverse(int n, double *operand, double *result);
+// multiplies matrices as MATRIX_Multiply does, with the tiles of the result shared among threads
+// takes the same arguments as MATRIX_Multiply and the number of threads to multiply with (including the calling thread)
+void MATRIX_MultiplyParallel(int n, int m, int p, double *left, double *right, double *result, int threads);
+
+// multiplies matrices with the plain triple loop, as a reference for MATRIX_Multiply
+// takes the same arguments as MATRIX_Multiply
+void MATRIX_MultiplyReference(int n, int m, int p, double *left, double *right, double *result);
+
+// factors an n by n matrix in place into lower and upper triangles with partial pivoting, so that solving with it costs no more than a product
+// elimination is blocked, the trailing matrix being updated by MATRIX_Multiply once per block of columns
+// takes n, the matrix, which is replaced by the unit lower triangle (diagonal not stored) and the upper triangle, and an array of n pivots,
+// pivots[i] being the row swapped with row i at step i
+// returns 0 if the matrix is singular, in which case the factors are incomplete, otherwise 1
+int MATRIX_LUFactor(int n, double *matrix, int *pivots);
+
+// solves systems with a matrix factored by MATRIX_LUFactor, any number at once
+// takes n, the factors and pivots, the number of right hand sides, and the n by count matrix of right hand sides, replaced by the solutions
+void MATRIX_LUSolve(int n, double *factors, int *pivots, int count, double *rhs);
+
+// factors a symmetric positive definite n by n matrix in place into a lower triangle L with L times its transpose equal to the matrix
+// at half the cost of MATRIX_LUFactor and with no pivoting, reading and writing only the lower triangle, the upper being left untouched
+// elimination is blocked as for MATRIX_LUFactor, the lower triangle of the trailing matrix updated by MATRIX_Multiply once per block of columns
+// takes n and the matrix
+// returns 0 if the matrix is not positive definite, in which case the factor is incomplete, otherwise 1
+int MATRIX_CholeskyFactor(int n, double *matrix);
+
+// solves systems with a matrix factored by MATRIX_CholeskyFactor, any number at once
+// takes n, the factor, the number of right hand sides, and the n by count matrix of right hand sides, replaced by the solutions
+void MATRIX_CholeskySolve(int n, double *factors, int count, double *rhs);
+
+// inverts an n by n matrix by solving with its LU factors, to be used only when the inverse itself is needed
+// takes n, the operand matrix, and the result matrix (may not be the same)
+// returns 0 if the operand is singular, in which case the result does not hold its inverse, otherwise 1
+int MATRIX_Inverse(int n, double *operand, double *result);
 
 #endif
@@ -0,0 +1,31 @@
+/*
+Header only helper for running a job on a number of threads, shared by the modules that split work among threads
+Workers share their job and take items from it themselves, typically under a mutex protected counter
+
+Copyright (C) 2015 Kyle Gagner
+All rights reserved
+*/
+
+// include guard
+#ifndef WORKERS_H
+#define WORKERS_H
+
+#include <threads.h>
+
+// runs a worker on the calling thread and on threads-1 more threads and waits for them all
+// threads that cannot be created are done without, the calling thread taking their share of the job
+// takes the worker, the argument shared between the threads, and the number of threads
+static inline void WORKERS_Run(thrd_start_t worker, void *job, int threads)
+{
+	int spawned = 0;
+	thrd_t workers[threads > 1 ? threads-1 : 1];
+	for(int i = 1; i < threads; i++)
+	{
+		if(thrd_create(&workers[spawned], worker, job) == thrd_success) spawned++;
+	}
+	// the calling thread works too
+	worker(job);
+	for(int i = 0; i < spawned; i++) thrd_join(workers[i], NULL);
+}
+
+#endif